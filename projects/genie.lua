@@ -122,6 +122,16 @@ newoption {
 	description = "Do build app."
 }
 
+newoption {
+	trigger = "with-avx2",
+	description = "Use AVX2 instructions, enables 8-wide float8 in simd.h."
+}
+
+newoption {
+	trigger = "with-null-gpu",
+	description = "Use null gpu backend, which records commands instead of rendering. No GPU is needed."
+}
+
 newoption {
 	trigger = "with-basis-universal",
 	description = "Use basis universal compression."
@@ -413,14 +423,15 @@ solution "LumixEngine"
 			"-ffunction-sections",
 			"-Wunused-value",
 			"-Wundef",
-			"-msse2",
+			"-msse4.1",
 			"-Wno-multichar",
 			"-Wno-undef",
 		}
 		
 		if "linux-clang" ~= _OPTIONS["gcc"] then
 			buildoptions { 
-				"-Wno-psabi"
+				"-Wno-psabi",
+				"-Wno-ignored-attributes"
 			}
 		else
 			buildoptions { 
@@ -437,6 +448,18 @@ solution "LumixEngine"
 		}
 
 	configuration {}
+
+	if _OPTIONS["with-avx2"] then
+		configuration { "linux" }
+			buildoptions { "-mavx2" }
+		configuration { "vs*" }
+			buildoptions { "/arch:AVX2" }
+		configuration {}
+	end
+
+	if _OPTIONS["with-null-gpu"] then
+		defines { "LUMIX_NULL_GPU" }
+	end
 	
 	configurations { "Debug", "RelWithDebInfo" }
 	platforms { "x64" }
@@ -576,6 +599,11 @@ if has_plugin("renderer") then
 			"../external/meshoptimizer/vfetchanalyzer.cpp",
 			"../external/meshoptimizer/vfetchoptimizer.cpp"
 		}
+		if _OPTIONS["with-null-gpu"] then
+			excludes { "../src/renderer/gpu/gpu.cpp" }
+		else
+			excludes { "../src/renderer/gpu/gpu_null.cpp" }
+		end
 		
 		if build_studio then
 			files {
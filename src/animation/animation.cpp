@@ -1,7 +1,9 @@
 #include "animation/animation.h"
+#include "engine/atomic.h"
 #include "engine/log.h"
 #include "engine/math.h"
 #include "engine/profiler.h"
+#include "engine/simd.h"
 #include "engine/stream.h"
 #include "engine/math.h"
 #include "renderer/model.h"
@@ -15,8 +17,24 @@ namespace Lumix
 const ResourceType Animation::TYPE("animation");
 
 
+static volatile i32 g_last_bone_mask_id = 0;
+
+
+BoneMask::BoneMask(IAllocator& allocator)
+	: bones(allocator)
+	, id(atomicIncrement(&g_last_bone_mask_id))
+{}
+
+
+void BoneMask::changed() {
+	prev_id = id;
+	id = atomicIncrement(&g_last_bone_mask_id);
+}
+
+
 Animation::Animation(const Path& path, ResourceManager& resource_manager, IAllocator& allocator)
 	: Resource(path, resource_manager, allocator)
+	, m_allocator(allocator)
 	, m_mem(allocator)
 	, m_translations(allocator)
 	, m_rotations(allocator)
@@ -24,14 +42,161 @@ Animation::Animation(const Path& path, ResourceManager& resource_manager, IAlloc
 }
 
 
+Animation::~Animation() {
+	clearBindings();
+}
+
+
+void Animation::clearBindings() {
+	Binding* binding = m_bindings;
+	while (binding) {
+		Binding* next = binding->next;
+		LUMIX_DELETE(m_allocator, binding);
+		binding = next;
+	}
+	m_bindings = nullptr;
+
+	binding = m_retired_bindings;
+	while (binding) {
+		Binding* next = binding->next_retired;
+		LUMIX_DELETE(m_allocator, binding);
+		binding = next;
+	}
+	m_retired_bindings = nullptr;
+}
+
+
+const Animation::Binding& Animation::getBinding(const Model& model, const BoneMask* mask) const {
+	const u32 bone_map_id = model.getBoneMapID();
+	const u32 mask_id = mask ? mask->id : 0;
+	auto find = [&]() -> const Binding* {
+		for (const Binding* b = m_bindings; b; b = b->next) {
+			if (b->bone_map_id == bone_map_id && b->mask_id == mask_id) return b;
+		}
+		return nullptr;
+	};
+
+	if (const Binding* b = find()) return *b;
+
+	MutexGuard guard(m_bindings_mutex);
+	if (const Binding* b = find()) return *b;
+
+	PROFILE_FUNCTION();
+	Binding* binding = LUMIX_NEW(m_allocator, Binding)(m_allocator);
+	binding->bone_map_id = bone_map_id;
+	binding->mask_id = mask_id;
+	auto bind = [&](BoneNameHash name, u32 curve_idx, Array<Binding::Entry>& entries){
+		Model::BoneMap::ConstIterator iter = model.getBoneIndex(name);
+		if (!iter.isValid()) return;
+		if (mask && !mask->bones.find(name).isValid()) return;
+		ASSERT(curve_idx <= 0xffFF);
+		entries.push({u16(curve_idx), u16(iter.value())});
+	};
+	for (i32 i = 0, c = m_translations.size(); i < c; ++i) bind(m_translations[i].name, i, binding->translations);
+	for (i32 i = 0, c = m_rotations.size(); i < c; ++i) bind(m_rotations[i].name, i, binding->rotations);
+
+	// unlink bindings made for the previous bone map of the model or the previous version of the mask,
+	// other threads can still be reading them, so they are freed only in clearBindings
+	auto matches = [](u32 id, u32 current, u32 prev) { return id == current || (prev != 0 && id == prev); };
+	const u32 prev_bone_map_id = model.getPrevBoneMapID();
+	const u32 prev_mask_id = mask ? mask->prev_id : 0;
+	Binding* volatile* link = &m_bindings;
+	while (Binding* b = *link) {
+		if (matches(b->bone_map_id, bone_map_id, prev_bone_map_id) && matches(b->mask_id, mask_id, prev_mask_id)) {
+			*link = b->next;
+			b->next_retired = m_retired_bindings;
+			m_retired_bindings = b;
+		}
+		else {
+			link = &b->next;
+		}
+	}
+
+	binding->next = m_bindings;
+	memoryBarrier();
+	m_bindings = binding;
+	return *binding;
+}
+
+
+static constexpr float SQRT1_2 = 0.70710678f;
+
+
 struct AnimationSampler {
-	template <bool use_mask, bool use_weight>
-	static void getRelativePose(const Animation& anim, Time time, Pose& pose, const Model& model, float weight, const BoneMask* mask) {
+	// first key with time > t, `hint` is the result of the previous search on this curve or anything else if unknown
+	static LUMIX_FORCE_INLINE u32 findKey(const u16* times, u32 count, u16 t, u32 hint) {
+		ASSERT(count > 1);
+		if (hint - 1 < count - 1 && times[hint - 1] <= t) {
+			// forward playback stays on the same key or moves by a few
+			for (u32 i = hint, end = minimum(hint + 4, count); i < end; ++i) {
+				if (times[i] > t) return i;
+			}
+		}
+
+		u32 from = 1;
+		u32 to = count - 1;
+		while (from < to) {
+			const u32 mid = (from + to) >> 1;
+			if (times[mid] > t) to = mid;
+			else from = mid + 1;
+		}
+		return from;
+	}
+
+	// lerp between keys idx and idx + 1
+	static LUMIX_FORCE_INLINE Vec3 lerpTranslation(const Animation::TranslationCurve& curve, u32 idx, float t) {
+		if (curve.pos) return lerp(curve.pos[idx], curve.pos[idx + 1], t);
+
+		const u16* q = curve.quantized + idx * 3;
+		alignas(16) float tmp[8] = { float(q[0]), float(q[1]), float(q[2]), 0, float(q[3]), float(q[4]), float(q[5]), 0 };
+		const float4 a = f4Load(tmp);
+		const float4 b = f4Load(tmp + 4);
+		const float4 v = f4Add(a, f4Mul(f4Sub(b, a), f4Splat(t)));
+		f4Store(tmp, f4Add(f4LoadUnaligned(&curve.min), f4Mul(v, f4LoadUnaligned(&curve.to_float))));
+		return Vec3(tmp[0], tmp[1], tmp[2]);
+	}
+
+	static LUMIX_FORCE_INLINE Vec3 translation(const Animation::TranslationCurve& curve, u32 idx) {
+		if (curve.pos) return curve.pos[idx];
+
+		const u16* q = curve.quantized + idx * 3;
+		alignas(16) float tmp[4] = { float(q[0]), float(q[1]), float(q[2]), 0 };
+		f4Store(tmp, f4Add(f4LoadUnaligned(&curve.min), f4Mul(f4Load(tmp), f4LoadUnaligned(&curve.to_float))));
+		return Vec3(tmp[0], tmp[1], tmp[2]);
+	}
+
+	static LUMIX_FORCE_INLINE Quat unpackRotation(const u16* packed) {
+		const u32 largest = (packed[0] >> 15) | ((packed[1] >> 15) << 1);
+		alignas(16) float tmp[4] = { float(packed[0] & 0x7fff), float(packed[1] & 0x7fff), float(packed[2] & 0x7fff), 0 };
+		f4Store(tmp, f4Sub(f4Mul(f4Load(tmp), f4Splat(2 * SQRT1_2 / 0x7fff)), f4Splat(SQRT1_2)));
+		const float w = sqrtf(maximum(0.f, 1 - tmp[0] * tmp[0] - tmp[1] * tmp[1] - tmp[2] * tmp[2]));
+		switch (largest) {
+			case 0: return Quat(w, tmp[0], tmp[1], tmp[2]);
+			case 1: return Quat(tmp[0], w, tmp[1], tmp[2]);
+			case 2: return Quat(tmp[0], tmp[1], w, tmp[2]);
+			default: return Quat(tmp[0], tmp[1], tmp[2], w);
+		}
+	}
+
+	// nlerp between keys idx and idx + 1
+	static LUMIX_FORCE_INLINE Quat lerpRotation(const Animation::RotationCurve& curve, u32 idx, float t) {
+		if (curve.rot) return nlerp(curve.rot[idx], curve.rot[idx + 1], t);
+		return nlerp(unpackRotation(curve.packed + idx * 3), unpackRotation(curve.packed + idx * 3 + 3), t);
+	}
+
+	static LUMIX_FORCE_INLINE Quat rotation(const Animation::RotationCurve& curve, u32 idx) {
+		if (curve.rot) return curve.rot[idx];
+		return unpackRotation(curve.packed + idx * 3);
+	}
+
+	template <bool use_weight, bool use_cursors>
+	static void getRelativePose(const Animation& anim, Time time, Pose& pose, const Model& model, float weight, const BoneMask* mask, u32* key_cursors) {
 		ASSERT(!pose.is_absolute);
 		ASSERT(model.isReady());
 
 		Vec3* pos = pose.positions;
 		Quat* rot = pose.rotations;
+		const Animation::Binding& binding = anim.getBinding(model, mask);
 
 		if (time < anim.getLength()) {
 			const u64 anim_t_highres = ((u64)time.raw() << 16) / (anim.m_length.raw());
@@ -42,115 +207,104 @@ struct AnimationSampler {
 			const u32 frame_idx = u32(frame_48_16 >> 16);
 			const float frame_t = (frame_48_16 & 0xffFF) / float(0xffFF);
 		
-			for (const Animation::TranslationCurve& curve : anim.m_translations) {
-				Model::BoneMap::ConstIterator iter = model.getBoneIndex(curve.name);
-				if (!iter.isValid()) continue;
-				if constexpr(use_mask) {
-					if (mask->bones.find(curve.name) == mask->bones.end()) continue;
-				}
+			for (const Animation::Binding::Entry& entry : binding.translations) {
+				const Animation::TranslationCurve& curve = anim.m_translations[entry.curve];
 
 				Vec3 anim_pos;
 				if (curve.times) {
-					u32 idx = 1;
-					for (u32 c = curve.count; idx < c; ++idx) {
-						if (curve.times[idx] > anim_t) break;
+					u32 idx;
+					if constexpr (use_cursors) {
+						idx = findKey(curve.times, curve.count, anim_t, key_cursors[entry.curve]);
+						key_cursors[entry.curve] = idx;
+					}
+					else {
+						idx = findKey(curve.times, curve.count, anim_t, 0);
 					}
 					const float t = float(anim_t - curve.times[idx - 1]) / (curve.times[idx] - curve.times[idx - 1]);
-					anim_pos = lerp(curve.pos[idx - 1], curve.pos[idx], t);
+					anim_pos = lerpTranslation(curve, idx - 1, t);
 				}
 				else {
-					anim_pos = lerp(curve.pos[frame_idx], curve.pos[frame_idx + 1], frame_t);
+					anim_pos = lerpTranslation(curve, frame_idx, frame_t);
 				}
 
-				const int model_bone_index = iter.value();
 				if constexpr (use_weight) {
-					pos[model_bone_index] = lerp(pos[model_bone_index], anim_pos, weight);
+					pos[entry.bone] = lerp(pos[entry.bone], anim_pos, weight);
 				}
 				else {
-					pos[model_bone_index] = anim_pos;
+					pos[entry.bone] = anim_pos;
 				}
 			}
 
-			for (const Animation::RotationCurve& curve : anim.m_rotations) {
-				Model::BoneMap::ConstIterator iter = model.getBoneIndex(curve.name);
-				if (!iter.isValid()) continue;
-				if constexpr(use_mask) {
-					if (mask->bones.find(curve.name) == mask->bones.end()) continue;
-				}
+			for (const Animation::Binding::Entry& entry : binding.rotations) {
+				const Animation::RotationCurve& curve = anim.m_rotations[entry.curve];
 
 				Quat anim_rot;
 				if(curve.times) {
-					u32 idx = 1;
-					for (u32 c = curve.count; idx < c; ++idx) {
-						if (curve.times[idx] > anim_t) break;
+					u32 idx;
+					if constexpr (use_cursors) {
+						u32& cursor = key_cursors[anim.m_translations.size() + entry.curve];
+						idx = findKey(curve.times, curve.count, anim_t, cursor);
+						cursor = idx;
+					}
+					else {
+						idx = findKey(curve.times, curve.count, anim_t, 0);
 					}
 					const float t = float(anim_t - curve.times[idx - 1]) / (curve.times[idx] - curve.times[idx - 1]);
-					anim_rot = nlerp(curve.rot[idx - 1], curve.rot[idx], t);
+					anim_rot = lerpRotation(curve, idx - 1, t);
 				}
 				else {
-					anim_rot = nlerp(curve.rot[frame_idx], curve.rot[frame_idx + 1], frame_t);
+					anim_rot = lerpRotation(curve, frame_idx, frame_t);
 				}
 
-				const int model_bone_index = iter.value();
 				if constexpr (use_weight) {
-					rot[model_bone_index] = nlerp(rot[model_bone_index], anim_rot, weight);
+					rot[entry.bone] = nlerp(rot[entry.bone], anim_rot, weight);
 				}
 				else {
-					rot[model_bone_index] = anim_rot;
+					rot[entry.bone] = anim_rot;
 				}
 			}
 		}
 		else {
-			for (const Animation::TranslationCurve& curve : anim.m_translations) {
-				Model::BoneMap::ConstIterator iter = model.getBoneIndex(curve.name);
-				if (!iter.isValid()) continue;
-				if constexpr(use_mask) {
-					if (mask->bones.find(curve.name) == mask->bones.end()) continue;
-				}
-
-				const int model_bone_index = iter.value();
+			for (const Animation::Binding::Entry& entry : binding.translations) {
+				const Animation::TranslationCurve& curve = anim.m_translations[entry.curve];
+				const Vec3 anim_pos = AnimationSampler::translation(curve, curve.count - 1);
 				if constexpr (use_weight) {
-					pos[model_bone_index] = lerp(pos[model_bone_index], curve.pos[curve.count - 1], weight);
+					pos[entry.bone] = lerp(pos[entry.bone], anim_pos, weight);
 				}
 				else {
-					pos[model_bone_index] = curve.pos[curve.count - 1];
+					pos[entry.bone] = anim_pos;
 				}
 			}
 
-			for (const Animation::RotationCurve& curve : anim.m_rotations) {
-				Model::BoneMap::ConstIterator iter = model.getBoneIndex(curve.name);
-				if (!iter.isValid()) continue;
-				if constexpr(use_mask) {
-					if (mask->bones.find(curve.name) == mask->bones.end()) continue;
-				}
-
-				const int model_bone_index = iter.value();
+			for (const Animation::Binding::Entry& entry : binding.rotations) {
+				const Animation::RotationCurve& curve = anim.m_rotations[entry.curve];
+				const Quat anim_rot = AnimationSampler::rotation(curve, curve.count - 1);
 				if constexpr (use_weight) {
-					rot[model_bone_index] = nlerp(rot[model_bone_index], curve.rot[curve.count - 1], weight);
+					rot[entry.bone] = nlerp(rot[entry.bone], anim_rot, weight);
 				}
 				else {
-					rot[model_bone_index] = curve.rot[curve.count - 1];
+					rot[entry.bone] = anim_rot;
 				}
 			}
 		}
 	}
 }; // AnimationSampler
 
-void Animation::getRelativePose(Time time, Pose& pose, const Model& model, float weight, const BoneMask* mask) const {
-	if (mask) {
+void Animation::getRelativePose(Time time, Pose& pose, const Model& model, float weight, const BoneMask* mask, u32* key_cursors) const {
+	if (key_cursors) {
 		if (weight < 0.9999f) {
-			AnimationSampler::getRelativePose<true, true>(*this, time, pose, model, weight, mask);
+			AnimationSampler::getRelativePose<true, true>(*this, time, pose, model, weight, mask, key_cursors);
 		}
 		else {
-			AnimationSampler::getRelativePose<true, false>(*this, time, pose, model, weight, mask);
+			AnimationSampler::getRelativePose<false, true>(*this, time, pose, model, weight, mask, key_cursors);
 		}
 	}
 	else {
 		if (weight < 0.9999f) {
-			AnimationSampler::getRelativePose<false, true>(*this, time, pose, model, weight, mask);
+			AnimationSampler::getRelativePose<true, false>(*this, time, pose, model, weight, mask, nullptr);
 		}
 		else {
-			AnimationSampler::getRelativePose<false, false>(*this, time, pose, model, weight, mask);
+			AnimationSampler::getRelativePose<false, false>(*this, time, pose, model, weight, mask, nullptr);
 		}
 	}
 }
@@ -164,13 +318,10 @@ Vec3 Animation::getTranslation(Time time, u32 curve_idx) const
 		const u16 anim_t = u16(anim_t_highres);
 
 		if (curve.times) {
-			u32 idx = 1;
-			for (u32 c = curve.count; idx < c; ++idx) {
-				if (curve.times[idx] > anim_t) break;
-			}
+			const u32 idx = AnimationSampler::findKey(curve.times, curve.count, anim_t, 0);
 
 			const float t = float(anim_t - curve.times[idx - 1]) / (curve.times[idx] - curve.times[idx - 1]);
-			return lerp(curve.pos[idx - 1], curve.pos[idx], t);
+			return AnimationSampler::lerpTranslation(curve, idx - 1, t);
 		}
 
 		const u64 frame_48_16 = (m_frame_count - 1) * anim_t_highres;
@@ -178,10 +329,10 @@ Vec3 Animation::getTranslation(Time time, u32 curve_idx) const
 		const u32 frame_idx = u32(frame_48_16 >> 16);
 		const float frame_t = (frame_48_16 & 0xffFF) / float(0xffFF);
 
-		return lerp(curve.pos[frame_idx], curve.pos[frame_idx + 1], frame_t);
+		return AnimationSampler::lerpTranslation(curve, frame_idx, frame_t);
 	}
 
-	return curve.pos[curve.count - 1];
+	return AnimationSampler::translation(curve, curve.count - 1);
 }
 
 int Animation::getTranslationCurveIndex(BoneNameHash name_hash) const {
@@ -207,13 +358,10 @@ Quat Animation::getRotation(Time time, u32 curve_idx) const
 		const u16 anim_t = u16(anim_t_highres);
 
 		if (curve.times) {
-			u32 idx = 1;
-			for (u32 c = curve.count; idx < c; ++idx) {
-				if (curve.times[idx] > anim_t) break;
-			}
+			const u32 idx = AnimationSampler::findKey(curve.times, curve.count, anim_t, 0);
 
 			const float t = float(anim_t - curve.times[idx - 1]) / (curve.times[idx] - curve.times[idx - 1]);
-			return nlerp(curve.rot[idx - 1], curve.rot[idx], t);
+			return AnimationSampler::lerpRotation(curve, idx - 1, t);
 		}
 
 		const u64 frame_48_16 = (m_frame_count - 1) * anim_t_highres;
@@ -221,23 +369,19 @@ Quat Animation::getRotation(Time time, u32 curve_idx) const
 		const u32 frame_idx = u32(frame_48_16 >> 16);
 		const float frame_t = (frame_48_16 & 0xffFF) / float(0xffFF);
 
-		return nlerp(curve.rot[frame_idx], curve.rot[frame_idx + 1], frame_t);
+		return AnimationSampler::lerpRotation(curve, frame_idx, frame_t);
 	}
 
-	return curve.rot[curve.count - 1];
+	return AnimationSampler::rotation(curve, curve.count - 1);
 }
 
 void Animation::getRelativePose(Time time, Pose& pose, const Model& model, const BoneMask* mask) const {
-	if(mask) {
-		AnimationSampler::getRelativePose<true, false>(*this, time, pose, model, 1, mask);
-	}
-	else {
-		AnimationSampler::getRelativePose<false, false>(*this, time, pose, model, 1, mask);
-	}
+	AnimationSampler::getRelativePose<false, false>(*this, time, pose, model, 1, mask, nullptr);
 }
 
 bool Animation::load(u64 mem_size, const u8* mem)
 {
+	clearBindings();
 	m_translations.clear();
 	m_rotations.clear();
 	m_mem.clear();
@@ -277,7 +421,16 @@ bool Animation::load(u64 mem_size, const u8* mem)
 		curve.count = blob.read<u32>();
 		ASSERT(curve.count > 1 || type != Animation::CurveType::KEYFRAMED);
 		curve.times = type == Animation::CurveType::KEYFRAMED ? (const u16*)blob.skip(curve.count * sizeof(u16)) : nullptr;
-		curve.pos = (const Vec3*)blob.skip(curve.count * sizeof(Vec3));
+		if (header.version <= Version::COMPRESSED) {
+			curve.pos = (const Vec3*)blob.skip(curve.count * sizeof(Vec3));
+			curve.quantized = nullptr;
+		}
+		else {
+			curve.min = Vec4(blob.read<Vec3>(), 0);
+			curve.to_float = Vec4(blob.read<Vec3>(), 0);
+			curve.pos = nullptr;
+			curve.quantized = (const u16*)blob.skip(curve.count * 3 * sizeof(u16));
+		}
 	}
 	
 	const u32 rotations_count = blob.read<u32>();
@@ -290,7 +443,14 @@ bool Animation::load(u64 mem_size, const u8* mem)
 		curve.count = blob.read<u32>();
 		ASSERT(curve.count > 1 || type != Animation::CurveType::KEYFRAMED);
 		curve.times = type == Animation::CurveType::KEYFRAMED ? (const u16*)blob.skip(curve.count * sizeof(u16)) : nullptr;
-		curve.rot = (const Quat*)blob.skip(curve.count * sizeof(Quat));
+		if (header.version <= Version::COMPRESSED) {
+			curve.rot = (const Quat*)blob.skip(curve.count * sizeof(Quat));
+			curve.packed = nullptr;
+		}
+		else {
+			curve.rot = nullptr;
+			curve.packed = (const u16*)blob.skip(curve.count * 3 * sizeof(u16));
+		}
 	}
 
 	return true;
@@ -299,6 +459,7 @@ bool Animation::load(u64 mem_size, const u8* mem)
 
 void Animation::unload()
 {
+	clearBindings();
 	m_translations.clear();
 	m_rotations.clear();
 	m_mem.clear();
@@ -2,16 +2,16 @@
 
 #include "engine/hash.h"
 #include "engine/hash_map.h"
+#include "engine/math.h"
 #include "engine/resource.h"
 #include "engine/string.h"
+#include "engine/sync.h"
 
 namespace Lumix
 {
 
 struct Model;
 struct Pose;
-struct Quat;
-struct Vec3;
 
 struct Time {
 	Time() {}
@@ -40,10 +40,15 @@ private:
 
 struct BoneMask
 {
-	BoneMask(IAllocator& allocator) : bones(allocator) {}
+	BoneMask(IAllocator& allocator);
 	BoneMask(BoneMask&& rhs) = default;
+	// call after changing `bones`, curve bindings cached in animations are keyed by id
+	void changed();
+
 	StaticString<32> name;
 	HashMap<BoneNameHash, u8> bones;
+	u32 id;
+	u32 prev_id = 0;
 };
 
 
@@ -61,6 +66,9 @@ struct Animation final : Resource
 
 		enum class Version : u32 {
 			FIRST = 3,
+			// translations quantized to 3 * u16 per curve range, rotations packed to 48 bits
+			// quantization error is range / (2 * 0xffFF), i.e. over 0.1mm only for curves with range over ~13m
+			COMPRESSED,
 
 			LAST
 		};
@@ -74,6 +82,7 @@ struct Animation final : Resource
 
 	public:
 		Animation(const Path& path, ResourceManager& resource_manager, IAllocator& allocator);
+		~Animation();
 
 		ResourceType getType() const override { return TYPE; }
 
@@ -82,7 +91,9 @@ struct Animation final : Resource
 		int getTranslationCurveIndex(BoneNameHash name_hash) const;
 		int getRotationCurveIndex(BoneNameHash name_hash) const;
 		void getRelativePose(Time time, Pose& pose, const Model& model, const BoneMask* mask) const;
-		void getRelativePose(Time time, Pose& pose, const Model& model, float weight, const BoneMask* mask) const;
+		// key_cursors - optional, getKeyCursorsCount() keys found by the previous call, speeds up forward playback of keyframed curves
+		void getRelativePose(Time time, Pose& pose, const Model& model, float weight, const BoneMask* mask, u32* key_cursors = nullptr) const;
+		u32 getKeyCursorsCount() const { return m_translations.size() + m_rotations.size(); }
 		Time getLength() const { return m_length; }
 
 	private:
@@ -96,20 +107,54 @@ struct Animation final : Resource
 			BoneNameHash name;
 			u32 count;
 			const u16* times;
+			// `pos` in old files, `quantized` otherwise; value = min + quantized * to_float, w is unused
 			const Vec3* pos;
+			const u16* quantized;
+			Vec4 min;
+			Vec4 to_float;
 		};
 		struct RotationCurve
 		{
 			BoneNameHash name;
 			u32 count;
 			const u16* times;
+			// `rot` in old files, `packed` otherwise
+			// packed - 3 smallest components in 15 bits each, index of the largest one in the top bits of first two u16s
 			const Quat* rot;
+			const u16* packed;
 		};
 		Array<TranslationCurve> m_translations;
 		Array<RotationCurve> m_rotations;
 		Array<u8> m_mem;
 		u32 m_frame_count = 0;
 
+		// curves resolved to bones of a model, filtered by a mask
+		struct Binding {
+			struct Entry {
+				u16 curve;
+				u16 bone;
+			};
+
+			Binding(IAllocator& allocator) : translations(allocator), rotations(allocator) {}
+
+			u32 bone_map_id;
+			u32 mask_id;
+			Array<Entry> translations;
+			Array<Entry> rotations;
+			Binding* next = nullptr;
+			Binding* next_retired = nullptr;
+		};
+
+		const Binding& getBinding(const Model& model, const BoneMask* mask) const;
+		void clearBindings();
+
+		IAllocator& m_allocator;
+		// read without lock, bindings are added while sampling, stale ones are moved to m_retired_bindings
+		// and all are freed in unload
+		mutable Binding* volatile m_bindings = nullptr;
+		mutable Binding* m_retired_bindings = nullptr;
+		mutable Mutex m_bindings_mutex;
+
 		friend struct AnimationSampler;
 };
 
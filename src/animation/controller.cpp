@@ -76,6 +76,8 @@ RuntimeContext* Controller::createRuntime(u32 anim_set) {
 	memset(ctx->inputs.begin(), 0, ctx->inputs.byte_size());
 	ctx->animations.resize(m_animation_slots.size());
 	memset(ctx->animations.begin(), 0, ctx->animations.byte_size());
+	ctx->key_cursors_ranges.resize(m_animation_slots.size());
+	memset(ctx->key_cursors_ranges.begin(), 0, ctx->key_cursors_ranges.byte_size());
 	for (AnimationEntry& anim : m_animation_entries) {
 		if (anim.set == anim_set) {
 			ctx->animations[anim.slot] = anim.animation;
@@ -1119,6 +1119,7 @@ struct ControllerEditorImpl : ControllerEditor {
 								else {
 									mask.bones.insert(bone_name_hash, 1);
 								}
+								mask.changed();
 							}
 						}
 						ImGui::TreePop();
@@ -82,9 +82,22 @@ RuntimeContext::RuntimeContext(Controller& controller, IAllocator& allocator)
 	, animations(allocator)
 	, events(allocator)
 	, input_runtime(nullptr, 0)
+	, key_cursors_ranges(allocator)
+	, key_cursors(allocator)
 {
 }
 
+u32* RuntimeContext::getKeyCursors(u32 slot, const Animation& anim) {
+	KeyCursorsRange& range = key_cursors_ranges[slot];
+	const u32 count = anim.getKeyCursorsCount();
+	if (range.size < count) {
+		range.offset = key_cursors.size();
+		range.size = count;
+		key_cursors.resize(range.offset + count);
+	}
+	return key_cursors.begin() + range.offset;
+}
+
 static u32 getInputByteOffset(Controller& controller, u32 input_idx) {
 	u32 offset = 0;
 	for (u32 i = 0; i < input_idx; ++i) {
@@ -204,7 +217,7 @@ void Blend1DNode::skip(RuntimeContext& ctx) const {
 	ctx.input_runtime.skip(sizeof(float));
 }
 
-static void getPose(const RuntimeContext& ctx, float rel_time, float weight, u32 slot, Pose& pose, u32 mask_idx, bool looped) {
+static void getPose(RuntimeContext& ctx, float rel_time, float weight, u32 slot, Pose& pose, u32 mask_idx, bool looped) {
 	Animation* anim = ctx.animations[slot];
 	if (!anim) return;
 	if (!ctx.model->isReady()) return;
@@ -214,10 +227,10 @@ static void getPose(const RuntimeContext& ctx, float rel_time, float weight, u32
 	const Time anim_time = looped ? time % anim->getLength() : minimum(time, anim->getLength());
 
 	const BoneMask* mask = mask_idx < (u32)ctx.controller.m_bone_masks.size() ? &ctx.controller.m_bone_masks[mask_idx] : nullptr;
-	anim->getRelativePose(anim_time, pose, *ctx.model, weight, mask);
+	anim->getRelativePose(anim_time, pose, *ctx.model, weight, mask, ctx.getKeyCursors(slot, *anim));
 }
 
-static void getPose(const RuntimeContext& ctx, Time time, float weight, u32 slot, Pose& pose, u32 mask_idx, bool looped) {
+static void getPose(RuntimeContext& ctx, Time time, float weight, u32 slot, Pose& pose, u32 mask_idx, bool looped) {
 	Animation* anim = ctx.animations[slot];
 	if (!anim) return;
 	if (!ctx.model->isReady()) return;
@@ -226,7 +239,7 @@ static void getPose(const RuntimeContext& ctx, Time time, float weight, u32 slot
 	const Time anim_time = looped ? time % anim->getLength() : minimum(time, anim->getLength());
 
 	const BoneMask* mask = mask_idx < (u32)ctx.controller.m_bone_masks.size() ? &ctx.controller.m_bone_masks[mask_idx] : nullptr;
-	anim->getRelativePose(anim_time, pose, *ctx.model, weight, mask);
+	anim->getRelativePose(anim_time, pose, *ctx.model, weight, mask, ctx.getKeyCursors(slot, *anim));
 }
 
 void Blend1DNode::getPose(RuntimeContext& ctx, float weight, Pose& pose, u32 mask) const {
@@ -637,4 +650,4 @@ Node* Node::create(GroupNode* parent, Type type, IAllocator& allocator) {
 }
 
 
-} // namespace Lumix::anim
\ No newline at end of file
+} // namespace Lumix::anim
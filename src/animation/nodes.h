@@ -22,6 +22,8 @@ struct RuntimeContext {
 
 	void setInput(u32 input_idx, float value);
 	void setInput(u32 input_idx, bool value);
+	// see Animation::getRelativePose
+	u32* getKeyCursors(u32 slot, const Animation& anim);
 
 	Controller& controller;
 	Array<u8> inputs;
@@ -33,6 +35,14 @@ struct RuntimeContext {
 	Time time_delta;
 	Model* model = nullptr;
 	InputMemoryStream input_runtime;
+
+	struct KeyCursorsRange {
+		u32 offset;
+		u32 size;
+	};
+	// per slot, cursors are only hints so they can stay in place when slot's animation changes
+	Array<KeyCursorsRange> key_cursors_ranges;
+	Array<u32> key_cursors;
 };
 
 struct Node {
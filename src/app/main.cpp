@@ -15,6 +15,7 @@
 #include "engine/profiler.h"
 #include "engine/reflection.h"
 #include "engine/resource_manager.h"
+#include "engine/string.h"
 #include "engine/thread.h"
 #include "engine/universe.h"
 #include "gui/gui_system.h"
@@ -22,6 +23,9 @@
 #include "renderer/pipeline.h"
 #include "renderer/render_scene.h"
 #include "renderer/renderer.h"
+#ifdef LUMIX_NULL_GPU
+	#include "renderer/gpu/gpu_null.h"
+#endif
 
 #ifdef __linux__
 	#define STB_IMAGE_IMPLEMENTATION
@@ -153,6 +157,25 @@ struct Runner final
 		return false;
 	}
 
+	void parseCommandLine() {
+		char cmd_line[2048];
+		os::getCommandLine(Span(cmd_line));
+
+		CommandLineParser parser(cmd_line);
+		while (parser.next()) {
+			if (parser.currentEquals("-frames")) {
+				if (!parser.next()) break;
+				char tmp[32];
+				parser.getCurrent(tmp, lengthOf(tmp));
+				fromCString(Span(tmp, stringLength(tmp)), m_max_frames);
+			}
+			else if (parser.currentEquals("-gpu_record")) {
+				if (!parser.next()) break;
+				parser.getCurrent(m_gpu_record_path.data, lengthOf(m_gpu_record_path.data));
+			}
+		}
+	}
+
 	void loadProject() {
 		FileSystem& fs = m_engine->getFileSystem();
 		OutputMemoryStream data(m_allocator);
@@ -174,6 +197,7 @@ struct Runner final
 		}
 
 		m_engine = Engine::create(static_cast<Engine::InitArgs&&>(init_data), m_allocator);
+		parseCommandLine();
 		
 		if (!isWindowCommandLineOption()) {
 			os::setFullscreen(m_engine->getWindowHandle());
@@ -205,7 +229,28 @@ struct Runner final
 		m_engine->startGame(*m_universe);
 	}
 
+	#ifdef LUMIX_NULL_GPU
+		// write commands recorded by null gpu backend in the last frame, see -gpu_dump
+		void saveGPURecord() {
+			OutputMemoryStream stream(m_allocator);
+			gpu::RecordStats stats;
+			gpu::getRecordedFrame(stream, stats);
+			logInfo("Last frame: ", stats.commands, " commands, ", stats.draw_calls, " draw calls, ", stats.dispatches, " dispatches, ", stats.bytes_uploaded, " bytes uploaded");
+
+			os::OutputFile file;
+			if (!file.open(m_gpu_record_path)) {
+				logError("Could not create ", m_gpu_record_path);
+				return;
+			}
+			if (!file.write(stream.data(), stream.size())) logError("Could not write ", m_gpu_record_path);
+			file.close();
+		}
+	#endif
+
 	void shutdown() {
+		#ifdef LUMIX_NULL_GPU
+			if (m_gpu_record_path.data[0]) saveGPURecord();
+		#endif
 		m_engine->destroyUniverse(*m_universe);
 		auto* gui = static_cast<GUISystem*>(m_engine->getPluginManager().getPlugin("gui"));
 		gui->setInterface(nullptr);
@@ -267,6 +312,9 @@ struct Runner final
 		m_pipeline->setViewport(m_viewport);
 		m_pipeline->render(false);
 		m_renderer->frame();
+
+		++m_frame;
+		if (m_max_frames != 0 && m_frame >= m_max_frames) m_finished = true;
 	}
 
 	DefaultAllocator m_main_allocator;
@@ -276,6 +324,9 @@ struct Runner final
 	Universe* m_universe = nullptr;
 	UniquePtr<Pipeline> m_pipeline;
 	char m_startup_universe[96] = "main";
+	u32 m_frame = 0;
+	u32 m_max_frames = 0;
+	StaticString<LUMIX_MAX_PATH> m_gpu_record_path;
 
 	Viewport m_viewport;
 	bool m_finished = false;
@@ -283,8 +334,43 @@ struct Runner final
 	GUIInterface m_gui_interface;
 };
 
+#ifdef LUMIX_NULL_GPU
+	// -gpu_dump path: decodes commands recorded with -gpu_record to path.txt
+	// returns exit code, -1 if there's nothing to dump
+	static int dumpGPURecord(int args, char* argv[]) {
+		for (int i = 1; i + 1 < args; ++i) {
+			if (!equalStrings(argv[i], "-gpu_dump")) continue;
+
+			const char* path = argv[i + 1];
+			DefaultAllocator allocator;
+			os::InputFile file;
+			if (!file.open(path)) return 1;
+			OutputMemoryStream stream(allocator);
+			stream.resize(file.size());
+			const bool read = file.read(stream.getMutableData(), stream.size());
+			file.close();
+			if (!read) return 1;
+
+			os::OutputFile out;
+			if (!out.open(StaticString<LUMIX_MAX_PATH>(path, ".txt"))) return 1;
+			gpu::RecordStats stats;
+			const bool valid = gpu::replay(stream, stats, &out);
+			out << "\n" << stats.commands << " commands, " << stats.draw_calls << " draw calls, " << stats.dispatches << " dispatches, "
+				<< stats.program_changes << " program changes, " << stats.framebuffer_changes << " framebuffer changes, "
+				<< stats.bytes_uploaded << " bytes uploaded\n";
+			out.close();
+			return valid ? 0 : 1;
+		}
+		return -1;
+	}
+#endif
+
 int main(int args, char* argv[])
 {
+	#ifdef LUMIX_NULL_GPU
+		const int dump_res = dumpGPURecord(args, argv);
+		if (dump_res >= 0) return dump_res;
+	#endif
 	profiler::setThreadName("Main thread");
 	struct Data {
 		Data() : semaphore(0, 1) {}
@@ -267,6 +267,7 @@ struct StudioAppImpl final : StudioApp
 			m_inactive_fps_timer.tick();
 		}
 
+		m_main_allocator.pushProfilerCounters();
 		profiler::frame();
 		m_events.clear();
 		m_is_f2_pressed = false;
@@ -3132,9 +3133,13 @@ struct StudioAppImpl final : StudioApp
 				logError("No files found while trying to create ", dest);
 				return;
 			}
-			u64 total_size = 0;
+			// offsets are relative to the end of the header
+			const u32 count = (u32)infos.size();
+			const u64 header_size = sizeof(count) + count * (sizeof(FilePathHash) + 2 * sizeof(u64));
+			u64 total_size = header_size;
 			for (ExportFileInfo& info : infos) {
-				info.offset = total_size;
+				total_size = (total_size + FileSystem::PAK_ALIGNMENT - 1) & ~u64(FileSystem::PAK_ALIGNMENT - 1);
+				info.offset = total_size - header_size;
 				total_size += info.size;
 			}
 			
@@ -3144,7 +3149,6 @@ struct StudioAppImpl final : StudioApp
 				return;
 			}
 
-			const u32 count = (u32)infos.size();
 			bool success = file.write(&count, sizeof(count));
 
 			for (auto& info : infos) {
@@ -3154,6 +3158,8 @@ struct StudioAppImpl final : StudioApp
 			}
 
 			OutputMemoryStream src(m_allocator);
+			const u8 padding[FileSystem::PAK_ALIGNMENT] = {};
+			u64 written = header_size;
 			for (const ExportFileInfo& info : infos) {
 				src.clear();
 				if (!fs.getContentSync(Path(info.path), src)) {
@@ -3161,7 +3167,17 @@ struct StudioAppImpl final : StudioApp
 					file.close();
 					return;
 				}
+				// header already has the size, the file changed since it was scanned
+				if (src.size() != info.size) {
+					logError("Size of ", info.path, " changed during export");
+					file.close();
+					return;
+				}
+				const u64 padding_size = header_size + info.offset - written;
+				ASSERT(padding_size < FileSystem::PAK_ALIGNMENT);
+				if (padding_size > 0) success = file.write(padding, padding_size) && success;
 				success = file.write(src.data(), src.size()) && success;
+				written += padding_size + src.size();
 			}
 			file.close();
 
@@ -3,6 +3,8 @@
 #include "engine/crt.h"
 #include "engine/math.h"
 #include "engine/os.h"
+#include "engine/profiler.h"
+#include "engine/string.h"
 #if !defined _WIN32 || defined __clang__
 	#include <string.h>
 	#include <malloc.h>
@@ -11,9 +13,14 @@
 
 namespace Lumix
 {
-	static constexpr u32 PAGE_SIZE = 4096;
-	static constexpr size_t MAX_PAGE_COUNT = 16384;
-	static constexpr u32 SMALL_ALLOC_MAX_SIZE = 64;
+	static constexpr u32 PAGE_SIZE = 16384;
+	static constexpr size_t MAX_PAGE_COUNT = 8192;
+	static constexpr u32 SMALL_ALLOC_MAX_SIZE = 1024;
+	// each thread is assigned one of the caches, threads assigned to the same cache fall back to m_mutex when they collide
+	static constexpr u32 THREAD_CACHE_COUNT = 64;
+	static constexpr u32 MAX_CACHED_ITEMS = 32;
+
+	static_assert(SMALL_ALLOC_MAX_SIZE == (8 << (DefaultAllocator::SMALL_BIN_COUNT - 1)));
 
 	struct DefaultAllocator::Page {
 		struct Header {
@@ -28,17 +35,36 @@ namespace Lumix
 
 	static_assert(sizeof(DefaultAllocator::Page) == PAGE_SIZE);
 
+	struct alignas(64) DefaultAllocator::ThreadCache {
+		struct Bin {
+			void* items[MAX_CACHED_ITEMS];
+			u32 count;
+		};
+
+		volatile i32 lock;
+		Bin bins[SMALL_BIN_COUNT];
+	};
+
+	static volatile i32 g_thread_cache_counter = 0;
+	static thread_local u32 g_thread_cache_idx = 0xffFFffFF;
+
 	static u32 sizeToBin(size_t n) {
-		ASSERT(n > 0);
 		ASSERT(n <= SMALL_ALLOC_MAX_SIZE);
+		if (n <= 8) return 0;
 		#ifdef _WIN32
 			unsigned long res;
-			return _BitScanReverse(&res, ((unsigned long)n - 1) >> 2) ? res : 0;
+			_BitScanReverse(&res, ((unsigned long)n - 1) >> 2);
+			return res;
 		#else
-			return 31 - __builtin_clz((n - 1) >> 2);
+			return 31 - __builtin_clz(u32(n - 1) >> 2);
 		#endif
 	}
 
+	// big items are not worth caching as much as small ones
+	static u32 getCacheCapacity(u32 bin) {
+		return minimum(MAX_CACHED_ITEMS, 8192 / (8 << bin));
+	}
+
 	void initPage(u32 item_size, DefaultAllocator::Page* page) {
 		os::memCommit(page, PAGE_SIZE);
 		page = new (NewPlaceholder(), page) DefaultAllocator::Page;
@@ -56,57 +82,26 @@ namespace Lumix
 		return (DefaultAllocator::Page*)((uintptr)ptr & ~u64(PAGE_SIZE - 1));
 	}
 
-	static void freeSmall(DefaultAllocator& allocator, void* mem) {
+	// call with allocator.m_mutex locked
+	static void freeToPage(DefaultAllocator& allocator, void* mem) {
 		u8* ptr = (u8*)mem;
 		DefaultAllocator::Page* page = getPage(ptr);
+		const u32 bin = sizeToBin(page->header.item_size);
 		
-		MutexGuard guard(allocator.m_mutex);
 		if (page->header.first_free + page->header.item_size > sizeof(page->data)) {
 			ASSERT(!page->header.next);
 			ASSERT(!page->header.prev);
-			const u32 bin = sizeToBin(page->header.item_size);
 			page->header.next = allocator.m_free_lists[bin];
 			allocator.m_free_lists[bin] = page;
 		}
 
 		*(u32*)ptr = page->header.first_free;
 		page->header.first_free = u32(ptr - page->data);
+		--allocator.m_bin_stats[bin].allocated;
 	}
 
-	static void* reallocSmall(DefaultAllocator& allocator, void* mem, size_t n) {
-		DefaultAllocator::Page* p = getPage(mem);
-		if (n <= SMALL_ALLOC_MAX_SIZE) {
-			const u32 bin = sizeToBin(n);
-			if (sizeToBin(p->header.item_size) == bin) return mem;
-		}
-		
-		void* new_mem = allocator.allocate(n);
-		memcpy(new_mem, mem, minimum((size_t)p->header.item_size, n));
-		allocator.deallocate(mem);
-		return new_mem;
-	}
-	
-	static void* reallocSmallAligned(DefaultAllocator& allocator, void* mem, size_t n, size_t align) {
-		DefaultAllocator::Page* p = getPage(mem);
-		if (n <= SMALL_ALLOC_MAX_SIZE) {
-			const u32 bin = sizeToBin(n);
-			if (sizeToBin(p->header.item_size) == bin) return mem;
-		}
-		
-		void* new_mem = allocator.allocate_aligned(n, align);
-		memcpy(new_mem, mem, minimum((size_t)p->header.item_size, n));
-		allocator.deallocate_aligned(mem);
-		return new_mem;
-	}
-
-	static void* allocSmall(DefaultAllocator& allocator, size_t n) {
-		const u32 bin = sizeToBin(n);
-
-		MutexGuard guard(allocator.m_mutex);
-
-		if (!allocator.m_small_allocations) {
-			allocator.m_small_allocations = (u8*)os::memReserve(PAGE_SIZE * MAX_PAGE_COUNT);
-		}
+	// call with allocator.m_mutex locked
+	static void* allocFromPage(DefaultAllocator& allocator, u32 bin) {
 		DefaultAllocator::Page* p = allocator.m_free_lists[bin];
 		if (!p) {
 			if (allocator.m_page_count == MAX_PAGE_COUNT) return nullptr;
@@ -115,12 +110,14 @@ namespace Lumix
 			initPage(8 << bin, p);
 			allocator.m_free_lists[bin] = p;
 			++allocator.m_page_count;
+			++allocator.m_bin_stats[bin].pages;
 		}
 
 		ASSERT(p->header.item_size > 0);
-		ASSERT(p->header.first_free + n < sizeof(p->data));
+		ASSERT(p->header.first_free + p->header.item_size <= sizeof(p->data));
 		void* res = &p->data[p->header.first_free];
 		p->header.first_free = *(u32*)res;
+		++allocator.m_bin_stats[bin].allocated;
 
 		const bool is_page_full = p->header.first_free + p->header.item_size > sizeof(p->data);
 		if (is_page_full) {
@@ -139,6 +136,124 @@ namespace Lumix
 		return res;
 	}
 
+	// call with allocator.m_mutex locked
+	static void initSmallAllocations(DefaultAllocator& allocator) {
+		if (allocator.m_small_allocations) return;
+
+		// reserve one more page so we can align the range, getPage depends on it
+		allocator.m_reserved = (u8*)os::memReserve(PAGE_SIZE * (MAX_PAGE_COUNT + 1));
+		allocator.m_small_allocations = (u8*)(((uintptr)allocator.m_reserved + PAGE_SIZE - 1) & ~u64(PAGE_SIZE - 1));
+
+		const size_t caches_size = sizeof(DefaultAllocator::ThreadCache) * THREAD_CACHE_COUNT;
+		void* caches = os::memReserve(caches_size);
+		os::memCommit(caches, caches_size);
+		memset(caches, 0, caches_size);
+		memoryBarrier();
+		allocator.m_thread_caches = (DefaultAllocator::ThreadCache*)caches;
+	}
+
+	// returns nullptr if another thread uses the same cache
+	static DefaultAllocator::ThreadCache* lockThreadCache(DefaultAllocator& allocator) {
+		if (!allocator.m_thread_caches) {
+			MutexGuard guard(allocator.m_mutex);
+			initSmallAllocations(allocator);
+		}
+
+		if (g_thread_cache_idx == 0xffFFffFF) {
+			g_thread_cache_idx = u32(atomicIncrement(&g_thread_cache_counter)) % THREAD_CACHE_COUNT;
+		}
+
+		DefaultAllocator::ThreadCache* cache = &allocator.m_thread_caches[g_thread_cache_idx];
+		if (!compareAndExchange(&cache->lock, 1, 0)) return nullptr;
+		return cache;
+	}
+
+	static void unlockThreadCache(DefaultAllocator::ThreadCache* cache) {
+		memoryBarrier();
+		cache->lock = 0;
+	}
+
+	static void freeSmall(DefaultAllocator& allocator, void* mem) {
+		const u32 bin = sizeToBin(getPage(mem)->header.item_size);
+		DefaultAllocator::ThreadCache* cache = lockThreadCache(allocator);
+		if (!cache) {
+			MutexGuard guard(allocator.m_mutex);
+			freeToPage(allocator, mem);
+			return;
+		}
+
+		DefaultAllocator::ThreadCache::Bin& cache_bin = cache->bins[bin];
+		const u32 capacity = getCacheCapacity(bin);
+		if (cache_bin.count == capacity) {
+			// return the older half to pages in one batch
+			MutexGuard guard(allocator.m_mutex);
+			const u32 half = capacity / 2;
+			for (u32 i = 0; i < half; ++i) {
+				freeToPage(allocator, cache_bin.items[i]);
+			}
+			memmove(cache_bin.items, cache_bin.items + half, (capacity - half) * sizeof(cache_bin.items[0]));
+			cache_bin.count -= half;
+		}
+		cache_bin.items[cache_bin.count] = mem;
+		++cache_bin.count;
+		unlockThreadCache(cache);
+	}
+
+	static void* allocSmall(DefaultAllocator& allocator, size_t n) {
+		const u32 bin = sizeToBin(n);
+		DefaultAllocator::ThreadCache* cache = lockThreadCache(allocator);
+		if (!cache) {
+			MutexGuard guard(allocator.m_mutex);
+			return allocFromPage(allocator, bin);
+		}
+
+		DefaultAllocator::ThreadCache::Bin& cache_bin = cache->bins[bin];
+		if (cache_bin.count == 0) {
+			// refill half of the cache in one batch
+			MutexGuard guard(allocator.m_mutex);
+			const u32 half = getCacheCapacity(bin) / 2;
+			for (u32 i = 0; i < half; ++i) {
+				void* mem = allocFromPage(allocator, bin);
+				if (!mem) break;
+				cache_bin.items[cache_bin.count] = mem;
+				++cache_bin.count;
+			}
+		}
+		void* res = nullptr;
+		if (cache_bin.count > 0) {
+			--cache_bin.count;
+			res = cache_bin.items[cache_bin.count];
+		}
+		unlockThreadCache(cache);
+		return res;
+	}
+
+	static void* reallocSmall(DefaultAllocator& allocator, void* mem, size_t n) {
+		DefaultAllocator::Page* p = getPage(mem);
+		if (n <= SMALL_ALLOC_MAX_SIZE) {
+			const u32 bin = sizeToBin(n);
+			if (sizeToBin(p->header.item_size) == bin) return mem;
+		}
+		
+		void* new_mem = allocator.allocate(n);
+		memcpy(new_mem, mem, minimum((size_t)p->header.item_size, n));
+		allocator.deallocate(mem);
+		return new_mem;
+	}
+	
+	static void* reallocSmallAligned(DefaultAllocator& allocator, void* mem, size_t n, size_t align) {
+		DefaultAllocator::Page* p = getPage(mem);
+		if (n <= SMALL_ALLOC_MAX_SIZE) {
+			const u32 bin = sizeToBin(n);
+			if (sizeToBin(p->header.item_size) == bin) return mem;
+		}
+		
+		void* new_mem = allocator.allocate_aligned(n, align);
+		memcpy(new_mem, mem, minimum((size_t)p->header.item_size, n));
+		allocator.deallocate_aligned(mem);
+		return new_mem;
+	}
+
 	static bool isSmallAlloc(DefaultAllocator& allocator, void* p) {
 		return allocator.m_small_allocations && p >= allocator.m_small_allocations && p < allocator.m_small_allocations + (PAGE_SIZE * MAX_PAGE_COUNT);
 	}
@@ -146,16 +261,59 @@ namespace Lumix
 	DefaultAllocator::DefaultAllocator() {
 		m_page_count = 0;
 		memset(m_free_lists, 0, sizeof(m_free_lists));
+		memset(m_bin_stats, 0, sizeof(m_bin_stats));
 	}
 
 	DefaultAllocator::~DefaultAllocator() {
-		os::memRelease(m_small_allocations, PAGE_SIZE * MAX_PAGE_COUNT);
+		if (m_thread_caches) {
+			os::memRelease(m_thread_caches, sizeof(ThreadCache) * THREAD_CACHE_COUNT);
+			os::memRelease(m_reserved, PAGE_SIZE * (MAX_PAGE_COUNT + 1));
+		}
+	}
+
+	DefaultAllocator::BinStats DefaultAllocator::getBinStats(u32 bin) const {
+		ASSERT(bin < SMALL_BIN_COUNT);
+		BinStats res = m_bin_stats[bin];
+		res.item_size = 8 << bin;
+		res.cached = 0;
+		if (m_thread_caches) {
+			// not synchronized, good enough for stats
+			for (u32 i = 0; i < THREAD_CACHE_COUNT; ++i) {
+				res.cached += m_thread_caches[i].bins[bin].count;
+			}
+		}
+		res.allocated = res.allocated > res.cached ? res.allocated - res.cached : 0;
+		return res;
+	}
+
+	void DefaultAllocator::pushProfilerCounters() const {
+		static u32 counters[SMALL_BIN_COUNT];
+		static u32 cached_counter;
+		static bool counters_created = [](){
+			for (u32 i = 0; i < SMALL_BIN_COUNT; ++i) {
+				const StaticString<64> name("Small allocations ", 8 << i, "B (KB)");
+				counters[i] = profiler::createCounter(name, 0);
+			}
+			cached_counter = profiler::createCounter("Small allocations cached (KB)", 0);
+			return true;
+		}();
+		(void)counters_created;
+
+		float cached = 0;
+		for (u32 i = 0; i < SMALL_BIN_COUNT; ++i) {
+			const BinStats stats = getBinStats(i);
+			profiler::pushCounter(counters[i], stats.allocated * stats.item_size / 1024.f);
+			cached += stats.cached * stats.item_size / 1024.f;
+		}
+		profiler::pushCounter(cached_counter, cached);
 	}
 
 	void* DefaultAllocator::allocate(size_t n)
 	{
 		if (n <= SMALL_ALLOC_MAX_SIZE) {
-			return allocSmall(*this, n);
+			// nullptr if all pages are used, isSmallAlloc routes the fallback to free()
+			void* res = allocSmall(*this, n);
+			if (res) return res;
 		}
 		return malloc(n);
 	}
@@ -183,7 +341,8 @@ namespace Lumix
 	void* DefaultAllocator::allocate_aligned(size_t size, size_t align)
 	{
 		if (size <= SMALL_ALLOC_MAX_SIZE && align <= size) {
-			return allocSmall(*this, size);
+			void* res = allocSmall(*this, size);
+			if (res) return res;
 		}
 		return _aligned_malloc(size, align);
 	}
@@ -209,18 +368,29 @@ namespace Lumix
 #else
 	void* DefaultAllocator::allocate_aligned(size_t size, size_t align)
 	{
+		if (size <= SMALL_ALLOC_MAX_SIZE && align <= size) {
+			void* res = allocSmall(*this, size);
+			if (res) return res;
+		}
 		return aligned_alloc(align, size);
 	}
 
 
 	void DefaultAllocator::deallocate_aligned(void* ptr)
 	{
+		if (isSmallAlloc(*this, ptr)) {
+			freeSmall(*this, ptr);
+			return;
+		}
 		free(ptr);
 	}
 
 
 	void* DefaultAllocator::reallocate_aligned(void* ptr, size_t size, size_t align)
 	{
+		if (isSmallAlloc(*this, ptr)) {
+			return reallocSmallAligned(*this, ptr, size, align);
+		}
 		// POSIX and glibc do not provide a way to realloc with alignment preservation
 		if (size == 0) {
 			free(ptr);
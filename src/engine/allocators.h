@@ -5,8 +5,19 @@
 
 namespace Lumix {
 
+// allocations up to 1KB are served from per-size pages, through per-thread caches
 struct LUMIX_ENGINE_API DefaultAllocator final : IAllocator {
 	struct Page;
+	struct ThreadCache;
+
+	enum { SMALL_BIN_COUNT = 8 };
+
+	struct BinStats {
+		u32 item_size;
+		u32 pages;
+		u32 allocated;
+		u32 cached; // free items in per-thread caches
+	};
 
 	DefaultAllocator();
 	~DefaultAllocator();
@@ -18,8 +29,14 @@ struct LUMIX_ENGINE_API DefaultAllocator final : IAllocator {
 	void deallocate_aligned(void* ptr) override;
 	void* reallocate_aligned(void* ptr, size_t size, size_t align) override;
 
+	BinStats getBinStats(u32 bin) const;
+	void pushProfilerCounters() const;
+
+	u8* m_reserved = nullptr;
 	u8* m_small_allocations = nullptr;
-	Page* m_free_lists[4];
+	ThreadCache* volatile m_thread_caches = nullptr;
+	Page* m_free_lists[SMALL_BIN_COUNT];
+	BinStats m_bin_stats[SMALL_BIN_COUNT];
 	u32 m_page_count = 0;
 	Mutex m_mutex;
 };
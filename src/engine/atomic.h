@@ -16,4 +16,25 @@ LUMIX_ENGINE_API bool compareAndExchange(i32 volatile* dest, i32 exchange, i32 c
 LUMIX_ENGINE_API bool compareAndExchange64(i64 volatile* dest, i64 exchange, i64 comperand);
 LUMIX_ENGINE_API void memoryBarrier();
 
+// relaxed, i.e. without ordering of other memory accesses, `value` must be 8 byte aligned
+LUMIX_FORCE_INLINE u64 atomicLoadRelaxed(const volatile u64* value)
+{
+	#ifdef _MSC_VER
+		return *value; // aligned 64bit access is atomic on x64
+	#else
+		return __atomic_load_n(value, __ATOMIC_RELAXED);
+	#endif
+}
+
+LUMIX_FORCE_INLINE void atomicStoreRelaxed(volatile u64* dest, u64 value)
+{
+	#ifdef _MSC_VER
+		*dest = value;
+	#else
+		__atomic_store_n(dest, value, __ATOMIC_RELAXED);
+	#endif
+}
+// hint to the cpu that we are in a spin-wait loop
+LUMIX_ENGINE_API void cpuRelax();
+
 } // namespace Lumix
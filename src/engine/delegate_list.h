@@ -56,6 +56,8 @@ template <typename R, typename... Args> struct DelegateList<R(Args...)> {
 		}
 	}
 
+	bool empty() const { return m_delegates.empty(); }
+
 	void invoke(Args... args)
 	{
 		for (i32 i = 0, c = m_delegates.size(); i < c; ++i) m_delegates[i].invoke(args...);
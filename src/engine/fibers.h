@@ -1,11 +1,6 @@
 #pragma once
 
 
-#ifdef __linux__
-	#include <ucontext.h>
-#endif
-
-
 namespace Lumix
 {
 
@@ -22,9 +17,9 @@ namespace Fiber
 	using FiberProc = void(__stdcall *)(void*);
 	constexpr Handle INVALID_FIBER = nullptr;
 #else 
-	using Handle = ucontext_t;
+	using Handle = struct Context*;
 	using FiberProc = void (*)(void*);
-	constexpr Handle INVALID_FIBER = {};
+	constexpr Handle INVALID_FIBER = nullptr;
 #endif
 
 
@@ -7,6 +7,7 @@
 #include "engine/hash_map.h"
 #include "engine/metaprogramming.h"
 #include "engine/log.h"
+#include "engine/math.h"
 #include "engine/sync.h"
 #include "engine/thread.h"
 #include "engine/os.h"
@@ -33,6 +34,10 @@ struct AsyncItem {
 	StaticString<LUMIX_MAX_PATH> path;
 	u32 id = 0;
 	FlagSet<Flags, u32> flags;
+	FileSystem::Priority priority = FileSystem::Priority::NORMAL;
+	u64 submit_time = 0;
+	// content owned by the file system, used instead of data
+	Span<const u8> view;
 };
 
 
@@ -40,6 +45,9 @@ struct FileSystemImpl;
 
 
 struct FSTask final : Thread {
+	// max number of requests a reader takes from the queue at once
+	enum { MAX_BATCH_SIZE = 8 };
+
 	FSTask(FileSystemImpl& fs, IAllocator& allocator)
 		: Thread(allocator)
 		, m_fs(fs)
@@ -47,32 +55,56 @@ struct FSTask final : Thread {
 
 	~FSTask() = default;
 
-	void stop();
 	int task() override;
 
 private:
 	FileSystemImpl& m_fs;
-	bool m_finish = false;
 };
 
 
 struct FileSystemImpl : FileSystem {
-	explicit FileSystemImpl(const char* base_path, IAllocator& allocator)
+	explicit FileSystemImpl(const char* base_path, u32 readers_count, IAllocator& allocator)
+		: FileSystemImpl(base_path, allocator)
+	{
+		createReaders(readers_count);
+	}
+
+	// without readers, derived class calls createReaders if it needs them
+	FileSystemImpl(const char* base_path, IAllocator& allocator)
 		: m_allocator(allocator)
 		, m_queue(allocator)	
+		, m_in_progress(allocator)	
 		, m_finished(allocator)	
+		, m_tasks(allocator)
 		, m_last_id(0)
 		, m_semaphore(0, 0xffFF)
 	{
 		setBasePath(base_path);
-		m_task.create(*this, m_allocator);
-		m_task->create("Filesystem", true);
+		m_read_speed_counter = profiler::createCounter("File system read (MB/s)", 0);
+		m_latency_counter = profiler::createCounter("File system request latency (ms)", 0);
+		m_stats_timestamp = os::Timer::getRawTimestamp();
+	}
+
+	void createReaders(u32 readers_count) {
+		if (readers_count == 0) readers_count = clamp(os::getCPUsCount() / 2, 1, 4);
+		for (u32 i = 0; i < readers_count; ++i) {
+			FSTask* task = LUMIX_NEW(m_allocator, FSTask)(*this, m_allocator);
+			if (!task->create("Filesystem", true)) {
+				logError("Failed to create filesystem reader thread.");
+				LUMIX_DELETE(m_allocator, task);
+				continue;
+			}
+			m_tasks.push(task);
+		}
 	}
 
 	~FileSystemImpl() override {
-		m_task->stop();
-		m_task->destroy();
-		m_task.destroy();
+		m_finish = true;
+		for (u32 i = 0; i < (u32)m_tasks.size(); ++i) m_semaphore.signal();
+		for (FSTask* task : m_tasks) {
+			task->destroy();
+			LUMIX_DELETE(m_allocator, task);
+		}
 	}
 
 
@@ -107,18 +139,50 @@ struct FileSystemImpl : FileSystem {
 		return true;
 	}
 
-	AsyncHandle getContent(const Path& file, const ContentCallback& callback) override
+	// content which does not need to be read, it must stay valid while the file system exists
+	virtual bool getContentView(const Path& path, Span<const u8>& view) { return false; }
+
+	AsyncHandle getContent(const Path& file, const ContentCallback& callback, Priority priority) override
 	{
 		if (file.isEmpty()) return AsyncHandle::invalid();
 
+		Span<const u8> view;
+		const bool has_view = getContentView(file, view);
+		if (has_view || m_tasks.empty()) {
+			// callback is still called from processCallbacks, callers expect the handle before the content
+			MutexGuard lock(m_mutex);
+			++m_work_counter;
+			AsyncItem& item = m_finished.emplace(m_allocator);
+			++m_last_id;
+			if (m_last_id == 0) ++m_last_id;
+			item.id = m_last_id;
+			item.path = file.c_str();
+			item.callback = callback;
+			item.priority = priority;
+			item.submit_time = os::Timer::getRawTimestamp();
+			if (has_view) {
+				item.view = view;
+			}
+			else if (!getContentSync(file, item.data)) {
+				// no readers to queue the request for
+				item.flags.set(AsyncItem::Flags::FAILED);
+			}
+			return AsyncHandle(item.id);
+		}
+
 		MutexGuard lock(m_mutex);
 		++m_work_counter;
-		AsyncItem& item = m_queue.emplace(m_allocator);
+		// queue is sorted by priority, most requests have the same priority so this usually does not loop
+		u32 idx = m_queue.size();
+		while (idx > 0 && m_queue[idx - 1].priority < priority) --idx;
+		AsyncItem& item = m_queue.emplaceAt(idx, m_allocator);
 		++m_last_id;
 		if (m_last_id == 0) ++m_last_id;
 		item.id = m_last_id;
 		item.path = file.c_str();
 		item.callback = callback;
+		item.priority = priority;
+		item.submit_time = os::Timer::getRawTimestamp();
 		m_semaphore.signal();
 		return AsyncHandle(item.id);
 	}
@@ -134,6 +198,13 @@ struct FileSystemImpl : FileSystem {
 				return;
 			}
 		}
+		for (AsyncItem& item : m_in_progress) {
+			if (item.id == async.value) {
+				item.flags.set(AsyncItem::Flags::CANCELED);
+				--m_work_counter;
+				return;
+			}
+		}
 		for (AsyncItem& item : m_finished) {
 			if (item.id == async.value) {
 				item.flags.set(AsyncItem::Flags::CANCELED);
@@ -223,10 +294,29 @@ struct FileSystemImpl : FileSystem {
 		return false;
 	}
 
+	void pushProfilerCounters(u32 finished_count, u64 latency_sum) {
+		const u64 now = os::Timer::getRawTimestamp();
+		const float dt = float(double(now - m_stats_timestamp) / os::Timer::getFrequency());
+		if (dt <= 0) return;
+
+		u64 bytes_read;
+		{
+			MutexGuard lock(m_mutex);
+			bytes_read = m_bytes_read;
+			m_bytes_read = 0;
+		}
+		m_stats_timestamp = now;
+		profiler::pushCounter(m_read_speed_counter, float(bytes_read / (1024.0 * 1024.0) / dt));
+		const float avg_latency = finished_count > 0 ? float(1000.0 * latency_sum / finished_count / os::Timer::getFrequency()) : 0;
+		profiler::pushCounter(m_latency_counter, avg_latency);
+	}
+
 	void processCallbacks() override
 	{
 		PROFILE_FUNCTION();
 
+		u32 finished_count = 0;
+		u64 latency_sum = 0;
 		os::Timer timer;
 		for(;;) {
 			m_mutex.enter();
@@ -242,7 +332,13 @@ struct FileSystemImpl : FileSystem {
 
 			m_mutex.exit();
 
-			if(!item.isCanceled()) {
+			++finished_count;
+			latency_sum += os::Timer::getRawTimestamp() - item.submit_time;
+			if (item.isCanceled()) {}
+			else if (item.view.begin()) {
+				item.callback.invoke(item.view.length(), item.view.begin(), true);
+			}
+			else {
 				item.callback.invoke(item.data.size(), (const u8*)item.data.data(), !item.isFailed());
 			}
 
@@ -250,16 +346,25 @@ struct FileSystemImpl : FileSystem {
 				break;
 			}
 		}
+		pushProfilerCounters(finished_count, latency_sum);
 	}
 
 	IAllocator& m_allocator;
-	Local<FSTask> m_task;
+	Array<FSTask*> m_tasks;
 	StaticString<LUMIX_MAX_PATH> m_base_path;
+	// sorted by priority, highest first
 	Array<AsyncItem> m_queue;
+	Array<AsyncItem> m_in_progress;
 	u32 m_work_counter = 0;
 	Array<AsyncItem> m_finished;
 	Mutex m_mutex;
 	Semaphore m_semaphore;
+	volatile bool m_finish = false;
+
+	u64 m_bytes_read = 0;
+	u64 m_stats_timestamp;
+	u32 m_read_speed_counter;
+	u32 m_latency_counter;
 
 	u32 m_last_id;
 };
@@ -267,53 +372,73 @@ struct FileSystemImpl : FileSystem {
 
 int FSTask::task()
 {
-	while (!m_finish) {
+	while (!m_fs.m_finish) {
 		m_fs.m_semaphore.wait();
-		if (m_finish) break;
+		if (m_fs.m_finish) break;
 
-		StaticString<LUMIX_MAX_PATH> path;
+		// take more requests at once if there are many of them, so readers do not fight over m_mutex
+		StaticString<LUMIX_MAX_PATH> paths[MAX_BATCH_SIZE];
+		u32 ids[MAX_BATCH_SIZE];
+		u32 count = 0;
 		{
 			MutexGuard lock(m_fs.m_mutex);
-			ASSERT(!m_fs.m_queue.empty());
-			path = m_fs.m_queue[0].path;
-			if (m_fs.m_queue[0].isCanceled()) {
+			const u32 batch_size = clamp(m_fs.m_queue.size() / m_fs.m_tasks.size(), 1, MAX_BATCH_SIZE);
+			while (count < batch_size && !m_fs.m_queue.empty()) {
+				AsyncItem& item = m_fs.m_queue[0];
+				if (!item.isCanceled()) {
+					paths[count] = item.path;
+					ids[count] = item.id;
+					++count;
+					m_fs.m_in_progress.push(static_cast<AsyncItem&&>(item));
+				}
 				m_fs.m_queue.erase(0);
-				continue;
 			}
 		}
 
-		OutputMemoryStream data(m_fs.m_allocator);
-		bool success = m_fs.getContentSync(Path(path), data);
+		for (u32 i = 0; i < count; ++i) {
+			OutputMemoryStream data(m_fs.m_allocator);
+			bool success;
+			{
+				PROFILE_BLOCK("read");
+				profiler::pushString(paths[i]);
+				success = m_fs.getContentSync(Path(paths[i]), data);
+				profiler::pushInt("size", (int)data.size());
+			}
 
-		{
 			MutexGuard lock(m_fs.m_mutex);
-			if (!m_fs.m_queue[0].isCanceled()) {
-				m_fs.m_finished.emplace(static_cast<AsyncItem&&>(m_fs.m_queue[0]));
-				m_fs.m_finished.back().data = static_cast<OutputMemoryStream&&>(data);
-				if(!success) {
-					m_fs.m_finished.back().flags.set(AsyncItem::Flags::FAILED);
+			m_fs.m_bytes_read += data.size();
+			for (u32 j = 0, c = m_fs.m_in_progress.size(); j < c; ++j) {
+				AsyncItem& item = m_fs.m_in_progress[j];
+				if (item.id != ids[i]) continue;
+
+				if (!item.isCanceled()) {
+					m_fs.m_finished.emplace(static_cast<AsyncItem&&>(item));
+					m_fs.m_finished.back().data = static_cast<OutputMemoryStream&&>(data);
+					if(!success) {
+						m_fs.m_finished.back().flags.set(AsyncItem::Flags::FAILED);
+					}
 				}
+				m_fs.m_in_progress.swapAndPop(j);
+				break;
 			}
-			m_fs.m_queue.erase(0);
 		}
 	}
 	return 0;
 }
 
-
-void FSTask::stop()
-{
-	m_finish = true;
-	m_fs.m_semaphore.signal();
-}
-
 struct PackFileSystem : FileSystemImpl {
-	PackFileSystem(const char* pak_path, IAllocator& allocator) 
+	struct PackFile {
+		u64 offset;
+		u64 size;
+	};
+
+	PackFileSystem(const char* pak_path, u32 readers_count, IAllocator& allocator) 
 		: FileSystemImpl("pack://", allocator) 
 		, m_map(allocator)
 	{
 		if (!m_file.open(pak_path)) {
 			logError("Failed to open game.pak");
+			createReaders(readers_count);
 			return;
 		}
 		const u32 count = m_file.read<u32>();
@@ -323,14 +448,25 @@ struct PackFileSystem : FileSystemImpl {
 			f.offset = m_file.read<u64>();
 			f.size = m_file.read<u64>();
 		}
+		m_header_size = m_file.pos();
+
+		// entries are used in place if we can map the pak, m_file is only a fallback
+		m_mapped = (const u8*)os::mapFile(pak_path, m_mapped_size);
+		if (m_mapped) {
+			// content is used in place, readers would be idle
+			m_file.close();
+		}
+		else {
+			createReaders(readers_count);
+		}
 	}
 
 	~PackFileSystem() {
+		if (m_mapped) os::unmapFile(m_mapped, m_mapped_size);
 		m_file.close();
 	}
 
-	bool getContentSync(const Path& path, OutputMemoryStream& content) override {
-		ASSERT(content.size() == 0);
+	const PackFile* getPackFile(const Path& path) const {
 		Span<const char> basename = Path::getBasename(path.c_str());
 		u64 hashu64;
 		fromCString(basename, hashu64);
@@ -341,38 +477,64 @@ struct PackFileSystem : FileSystemImpl {
 		auto iter = m_map.find(hash);
 		if (!iter.isValid()) {
 			iter = m_map.find(path.getHash());
-			if (!iter.isValid()) return false;
+			if (!iter.isValid()) return nullptr;
 		}
+		return &iter.value();
+	}
 
-		content.resize(iter.value().size);
-		MutexGuard lock(m_mutex);
-		const u32 header_size = sizeof(u32) + m_map.size() * (2 * sizeof(u64) + sizeof(u32));
-		if (!m_file.seek(iter.value().offset + header_size) || !m_file.read(content.getMutableData(), content.size())) {
+	bool getContentView(const Path& path, Span<const u8>& view) override {
+		if (!m_mapped) return false;
+
+		const PackFile* f = getPackFile(path);
+		if (!f) return false;
+		if (m_header_size + f->offset + f->size > m_mapped_size) return false;
+
+		view = Span(m_mapped + m_header_size + f->offset, (u32)f->size);
+		return true;
+	}
+
+	bool getContentSync(const Path& path, OutputMemoryStream& content) override {
+		ASSERT(content.size() == 0);
+		const PackFile* f = getPackFile(path);
+		if (!f) return false;
+
+		if (m_mapped) {
+			if (m_header_size + f->offset + f->size > m_mapped_size) {
+				logError("Could not read ", path);
+				return false;
+			}
+			content.write(m_mapped + m_header_size + f->offset, f->size);
+			return true;
+		}
+
+		content.resize(f->size);
+		MutexGuard lock(m_file_mutex);
+		if (!m_file.seek(f->offset + m_header_size) || !m_file.read(content.getMutableData(), content.size())) {
 			logError("Could not read ", path);
 			return false;
 		}
 
 		return true;
 	}
-	
-	struct PackFile {
-		u64 offset;
-		u64 size;
-	};
 
 	HashMap<FilePathHash, PackFile> m_map;
+	u64 m_header_size = 0;
 	os::InputFile m_file;
+	// readers share m_file
+	Mutex m_file_mutex;
+	const u8* m_mapped = nullptr;
+	u64 m_mapped_size = 0;
 };
 
 
-UniquePtr<FileSystem> FileSystem::create(const char* base_path, IAllocator& allocator)
+UniquePtr<FileSystem> FileSystem::create(const char* base_path, IAllocator& allocator, u32 readers_count)
 {
-	return UniquePtr<FileSystemImpl>::create(allocator, base_path, allocator);
+	return UniquePtr<FileSystemImpl>::create(allocator, base_path, readers_count, allocator);
 }
 
-UniquePtr<FileSystem> FileSystem::createPacked(const char* pak_path, IAllocator& allocator)
+UniquePtr<FileSystem> FileSystem::createPacked(const char* pak_path, IAllocator& allocator, u32 readers_count)
 {
-	return UniquePtr<PackFileSystem>::create(allocator, pak_path, allocator);
+	return UniquePtr<PackFileSystem>::create(allocator, pak_path, readers_count, allocator);
 }
 
 
@@ -16,6 +16,13 @@ namespace os {
 struct LUMIX_ENGINE_API FileSystem {
 	using ContentCallback = Delegate<void(u64, const u8*, bool)>;
 
+	// requests with higher priority are read first, same priority requests are read in submission order
+	enum class Priority : u8 {
+		LOW,
+		NORMAL,
+		HIGH
+	};
+
 	struct LUMIX_ENGINE_API AsyncHandle {
 		static AsyncHandle invalid() { return AsyncHandle(0xffFFffFF); }
 		explicit AsyncHandle(u32 value) : value(value) {}
@@ -23,8 +30,13 @@ struct LUMIX_ENGINE_API FileSystem {
 		bool isValid() const { return value != 0xffFFffFF; }
 	};
 
-	static UniquePtr<FileSystem> create(const char* base_path, struct IAllocator& allocator);
-	static UniquePtr<FileSystem> createPacked(const char* pak_path, struct IAllocator& allocator);
+	// readers_count == 0 - pick number of reader threads based on cpu count
+	// pak entries written by the editor start at multiples of this, counted from the start of the file
+	// so entries used in place from a mapped pak are aligned
+	static constexpr u32 PAK_ALIGNMENT = 16;
+
+	static UniquePtr<FileSystem> create(const char* base_path, struct IAllocator& allocator, u32 readers_count = 0);
+	static UniquePtr<FileSystem> createPacked(const char* pak_path, struct IAllocator& allocator, u32 readers_count = 0);
 
 	virtual ~FileSystem() {}
 
@@ -45,7 +57,7 @@ struct LUMIX_ENGINE_API FileSystem {
 	virtual void makeAbsolute(Span<char> absolute, const char* relative) const = 0;
 
 	[[nodiscard]] virtual bool getContentSync(const struct Path& file, struct OutputMemoryStream& content) =  0;
-	virtual AsyncHandle getContent(const Path& file, const ContentCallback& callback) = 0;
+	virtual AsyncHandle getContent(const Path& file, const ContentCallback& callback, Priority priority = Priority::NORMAL) = 0;
 	virtual void cancel(AsyncHandle handle) = 0;
 };
 
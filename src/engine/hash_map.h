@@ -3,6 +3,11 @@
 
 #include "engine/allocator.h"
 #include "engine/lumix.h"
+#include "engine/simd.h"
+#ifdef _WIN32
+	#include <intrin.h>
+#endif
+#include <string.h>
 
 
 namespace Lumix
@@ -109,15 +114,52 @@ struct HashFuncDirect {
 	static u32 get(T key) { return key; }
 };
 
+// open addressing with linear probing, control bytes are probed a group at a time
+// each slot has a control byte, EMPTY or 7 high bits of the key's hash
+// first GROUP_SIZE control bytes are mirrored after the end, so groups can be loaded without wrapping
+// erase shifts the following keys back, there are no tombstones
 template<typename Key, typename Value, typename Hasher = HashFunc<Key>>
 struct HashMap
 {
 private:
-	struct Slot {
-		alignas(Key) u8 key_mem[sizeof(Key)];
-		bool valid;
-		//u8 padding[3];
-	};
+	enum : u8 { EMPTY = 0x80 };
+	enum { GROUP_SIZE = 16 };
+
+	// bit i is set if ctrl[i] == tag
+	static LUMIX_FORCE_INLINE u32 matchTag(const u8* ctrl, u8 tag) {
+		#ifdef LUMIX_SIMD_SSE
+			const __m128i group = _mm_loadu_si128((const __m128i*)ctrl);
+			return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)tag)));
+		#else
+			u32 res = 0;
+			for (u32 i = 0; i < GROUP_SIZE; ++i) res |= u32(ctrl[i] == tag) << i;
+			return res;
+		#endif
+	}
+
+	// bit i is set if ctrl[i] == EMPTY
+	static LUMIX_FORCE_INLINE u32 matchEmpty(const u8* ctrl) {
+		#ifdef LUMIX_SIMD_SSE
+			return (u32)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)ctrl));
+		#else
+			u32 res = 0;
+			for (u32 i = 0; i < GROUP_SIZE; ++i) res |= u32(ctrl[i] >> 7) << i;
+			return res;
+		#endif
+	}
+
+	static LUMIX_FORCE_INLINE u32 lowestBit(u32 mask) {
+		ASSERT(mask);
+		#ifdef _WIN32
+			unsigned long res;
+			_BitScanForward(&res, mask);
+			return res;
+		#else
+			return __builtin_ctz(mask);
+		#endif
+	}
+
+	static LUMIX_FORCE_INLINE u8 getTag(u32 hash) { return u8(hash >> 25); }
 
 	template <typename HM, typename K, typename V>
 	struct IteratorBase {
@@ -136,34 +178,25 @@ private:
 			return idx == rhs.idx;
 		}
 
-		void operator++() { 
-			const Slot* keys = hm->m_keys;
-			for(u32 i = idx + 1, c = hm->m_capacity; i < c; ++i) {
-				if(keys[i].valid) {
-					idx = i;
-					return;
-				}
-			}
-			idx = hm->m_capacity;
-		}
+		void operator++() { idx = hm->nextValid(idx + 1); }
 
 		K& key() {
-			ASSERT(hm->m_keys[idx].valid);
-			return *((Key*)hm->m_keys[idx].key_mem);
+			ASSERT(hm->m_ctrl[idx] != EMPTY);
+			return hm->m_keys[idx];
 		}
 
 		const V& value() const {
-			ASSERT(hm->m_keys[idx].valid);
+			ASSERT(hm->m_ctrl[idx] != EMPTY);
 			return hm->m_values[idx];
 		}
 
 		V& value() {
-			ASSERT(hm->m_keys[idx].valid);
+			ASSERT(hm->m_ctrl[idx] != EMPTY);
 			return hm->m_values[idx];
 		}
 
 		V& operator*() {
-			ASSERT(hm->m_keys[idx].valid);
+			ASSERT(hm->m_ctrl[idx] != EMPTY);
 			return hm->m_values[idx];
 		}
 
@@ -182,18 +215,20 @@ public:
 	HashMap(u32 size, IAllocator& allocator) 
 		: m_allocator(allocator) 
 	{
-		init(size, true);
+		init(size);
 	}
 
 	HashMap(HashMap&& rhs)
 		: m_allocator(rhs.m_allocator)
 	{
+		m_ctrl = rhs.m_ctrl;
 		m_keys = rhs.m_keys;
 		m_values = rhs.m_values;
 		m_capacity = rhs.m_capacity;
 		m_size = rhs.m_size;
 		m_mask = rhs.m_mask;
 		
+		rhs.m_ctrl = nullptr;
 		rhs.m_keys = nullptr;
 		rhs.m_values = nullptr;
 		rhs.m_capacity = 0;
@@ -203,13 +238,8 @@ public:
 
 	~HashMap()
 	{
-		for(u32 i = 0, c = m_capacity; i < c; ++i) {
-			if (m_keys[i].valid) {
-				((Key*)m_keys[i].key_mem)->~Key();
-				m_values[i].~Value();
-				m_keys[i].valid = false;
-			}
-		}
+		destroyAll();
+		m_allocator.deallocate(m_ctrl);
 		m_allocator.deallocate(m_keys);
 		m_allocator.deallocate(m_values);
 	}
@@ -220,34 +250,18 @@ public:
 
 	void operator =(HashMap&& rhs) = delete;
 
-	Iterator begin() {
-		for (u32 i = 0, c = m_capacity; i < c; ++i) {
-			if (m_keys[i].valid) return { this, i };
-		}
-		return { this, m_capacity };
-	}
-
-	ConstIterator begin() const {
-		for (u32 i = 0, c = m_capacity; i < c; ++i) {
-			if (m_keys[i].valid) return { this, i };
-		}
-		return { this, m_capacity };
-	}
+	Iterator begin() { return { this, nextValid(0) }; }
+	ConstIterator begin() const { return { this, nextValid(0) }; }
 
 	Iterator end() { return Iterator { this, m_capacity }; }
 	ConstIterator end() const { return ConstIterator { this, m_capacity }; }
 
 	void clear() {
-		for(u32 i = 0, c = m_capacity; i < c; ++i) {
-			if (m_keys[i].valid) {
-				((Key*)m_keys[i].key_mem)->~Key();
-				m_values[i].~Value();
-				m_keys[i].valid = false;
-			}
-		}
+		destroyAll();
+		m_allocator.deallocate(m_ctrl);
 		m_allocator.deallocate(m_keys);
 		m_allocator.deallocate(m_values);
-		init(8, true);
+		init(8);
 	}
 
 	ConstIterator find(const Key& key) const {
@@ -276,86 +290,39 @@ public:
 	}
 
 	Iterator insert(const Key& key, Value&& value) {
-		if (m_size >= m_capacity * 3 / 4) {
-			grow((m_capacity << 1) < 8 ? 8 : m_capacity << 1);
-		}
-
-		u32 pos = Hasher::get(key) & m_mask;
-		while (m_keys[pos].valid) ++pos;
-		if(pos == m_capacity) {
-			pos = 0;
-			while (m_keys[pos].valid) ++pos;
-		}
-
-		new (NewPlaceholder(), m_keys[pos].key_mem) Key(key);
+		const u32 pos = prepareInsert(key);
+		new (NewPlaceholder(), &m_keys[pos]) Key(key);
 		new (NewPlaceholder(), &m_values[pos]) Value(static_cast<Value&&>(value));
-		++m_size;
-		m_keys[pos].valid = true;
-
 		return { this, pos };
 	}
 
 	Iterator insert(const Key& key, const Value& value) {
-		if (m_size >= m_capacity * 3 / 4) {
-			grow((m_capacity << 1) < 8 ? 8 : m_capacity << 1);
-		}
-
-		u32 pos = Hasher::get(key) & m_mask;
-		while (m_keys[pos].valid) ++pos;
-		if(pos == m_capacity) {
-			pos = 0;
-			while (m_keys[pos].valid) ++pos;
-		}
-
-		new (NewPlaceholder(), m_keys[pos].key_mem) Key(key);
+		const u32 pos = prepareInsert(key);
+		new (NewPlaceholder(), &m_keys[pos]) Key(key);
 		new (NewPlaceholder(), &m_values[pos]) Value(value);
-		++m_size;
-		m_keys[pos].valid = true;
-
 		return { this, pos };
 	}
 
 	template <typename F>
 	void eraseIf(F predicate) {
-		Slot* keys = m_keys;
-		for (u32 i = 0; i < m_capacity; ++i) {
-			if (!keys[i].valid) continue;
+		for (u32 i = nextValid(0); i < m_capacity; ) {
 			if (predicate(m_values[i])) {
-				((Key*)keys[i].key_mem)->~Key();
-				m_values[i].~Value();
-				keys[i].valid = false;
-				--m_size;
-
-				u32 pos = (i + 1) % m_capacity;
-				while (keys[pos].valid) {
-					rehash(pos);
-					pos = (pos + 1) % m_capacity;
-				}
-				--i;
+				// a following key can be shifted to i, so check i again
+				eraseAt(i);
+				if (m_ctrl[i] != EMPTY) continue;
 			}
+			i = nextValid(i + 1);
 		}
 	}
 
 	void erase(const Iterator& key) {
 		ASSERT(key.isValid());
-
-		Slot* keys = m_keys;
-		u32 pos = key.idx;
-		((Key*)keys[pos].key_mem)->~Key();
-		m_values[pos].~Value();
-		keys[pos].valid = false;
-		--m_size;
-
-		pos = (pos + 1) & m_mask;
-		while (keys[pos].valid) {
-			rehash(pos);
-			pos = (pos + 1) % m_capacity;
-		}
+		eraseAt(key.idx);
 	}
 
 	void erase(const Key& key) {
 		const u32 pos = findPos(key);
-		if (m_keys[pos].valid) erase(Iterator{this, pos});
+		if (pos < m_capacity) eraseAt(pos);
 	}
 
 	bool empty() const { return m_size == 0; }
@@ -384,84 +351,132 @@ private:
 		return v;
 	}
 
+	// first used slot at or after `from`, m_capacity if there is none
+	u32 nextValid(u32 from) const {
+		for (u32 i = from, c = m_capacity; i < c; i += GROUP_SIZE) {
+			const u32 used = ~matchEmpty(m_ctrl + i) & 0xffff;
+			if (used) {
+				const u32 pos = i + lowestBit(used);
+				// mirrored bytes after the end
+				return pos < c ? pos : c;
+			}
+		}
+		return m_capacity;
+	}
+
+	void setCtrl(u32 pos, u8 value) {
+		m_ctrl[pos] = value;
+		for (u32 i = pos + m_capacity; i < m_capacity + GROUP_SIZE; i += m_capacity) {
+			m_ctrl[i] = value;
+		}
+	}
+
+	void destroyAll() {
+		for (u32 i = nextValid(0); i < m_capacity; i = nextValid(i + 1)) {
+			m_keys[i].~Key();
+			m_values[i].~Value();
+		}
+	}
+
 	void grow(u32 new_capacity) {
 		HashMap<Key, Value, Hasher> tmp(new_capacity, m_allocator);
-		if (m_size > 0) {
-			for(auto iter = begin(); iter.isValid(); ++iter) {
-				tmp.insert(iter.key(), static_cast<Value&&>(iter.value()));
-			}
+		for (u32 i = nextValid(0); i < m_capacity; i = nextValid(i + 1)) {
+			const u32 pos = tmp.prepareInsert(m_keys[i]);
+			new (NewPlaceholder(), &tmp.m_keys[pos]) Key(static_cast<Key&&>(m_keys[i]));
+			new (NewPlaceholder(), &tmp.m_values[pos]) Value(static_cast<Value&&>(m_values[i]));
 		}
 
 		swap(m_capacity, tmp.m_capacity);
 		swap(m_size, tmp.m_size);
 		swap(m_mask, tmp.m_mask);
+		swap(m_ctrl, tmp.m_ctrl);
 		swap(m_keys, tmp.m_keys);
 		swap(m_values, tmp.m_values);
 	}
 
-	u32 findEmptySlot(const Key& key, u32 end_pos) const {
-		const u32 mask = m_mask;
-		u32 pos = Hasher::get(key) & mask;
-		while (m_keys[pos].valid && pos != end_pos) ++pos;
-		if (pos == m_capacity) {
-			pos = 0;
-			while (m_keys[pos].valid && pos != end_pos) ++pos;
+	// marks an empty slot for key as used, caller constructs the key and the value
+	u32 prepareInsert(const Key& key) {
+		if (m_size >= m_capacity * 3 / 4) {
+			grow((m_capacity << 1) < 8 ? 8 : m_capacity << 1);
+		}
+
+		const u32 hash = Hasher::get(key);
+		u32 pos = hash & m_mask;
+		for (;;) {
+			const u32 empty = matchEmpty(m_ctrl + pos);
+			if (empty) {
+				pos = (pos + lowestBit(empty)) & m_mask;
+				break;
+			}
+			pos = (pos + GROUP_SIZE) & m_mask;
 		}
+		setCtrl(pos, getTag(hash));
+		++m_size;
 		return pos;
 	}
 
-	void rehash(u32 pos) {
-		Key& key = *((Key*)m_keys[pos].key_mem);
-		const u32 rehashed_pos = findEmptySlot(key, pos);
-		if (rehashed_pos != pos) {
-			new (NewPlaceholder(), m_keys[rehashed_pos].key_mem) Key(static_cast<Key&&>(key));
-			new (NewPlaceholder(), &m_values[rehashed_pos]) Value(static_cast<Value&&>(m_values[pos]));
-			
-			((Key*)m_keys[pos].key_mem)->~Key();
-			m_values[pos].~Value();
-			m_keys[pos].valid = false;
-			m_keys[rehashed_pos].valid = true;
+	void eraseAt(u32 pos) {
+		ASSERT(m_ctrl[pos] != EMPTY);
+		m_keys[pos].~Key();
+		m_values[pos].~Value();
+		--m_size;
+
+		// shift back following keys which would not be found across the hole
+		const u32 mask = m_mask;
+		u32 hole = pos;
+		for (u32 i = (pos + 1) & mask; m_ctrl[i] != EMPTY; i = (i + 1) & mask) {
+			const u32 home = Hasher::get(m_keys[i]) & mask;
+			if (((i - home) & mask) < ((i - hole) & mask)) continue;
+
+			new (NewPlaceholder(), &m_keys[hole]) Key(static_cast<Key&&>(m_keys[i]));
+			new (NewPlaceholder(), &m_values[hole]) Value(static_cast<Value&&>(m_values[i]));
+			m_keys[i].~Key();
+			m_values[i].~Value();
+			setCtrl(hole, m_ctrl[i]);
+			hole = i;
 		}
+		setCtrl(hole, EMPTY);
 	}
 
 	u32 findPos(const Key& key) const {
-		u32 pos = Hasher::get(key) & m_mask;
-		const Slot* LUMIX_RESTRICT keys = m_keys;
-		if (!keys) {
+		if (!m_ctrl) {
 			ASSERT(m_capacity == 0);
 			return 0;
 		}
-		while (keys[pos].valid) {
-			if (*((Key*)keys[pos].key_mem) == key) return pos;
-			++pos;
-		}
-		if (pos != m_capacity) return m_capacity;
-		pos = 0;
-		while (keys[pos].valid) {
-			if (*((Key*)keys[pos].key_mem) == key) return pos;
-			++pos;
+		const u32 hash = Hasher::get(key);
+		const u8 tag = getTag(hash);
+		const u8* LUMIX_RESTRICT ctrl = m_ctrl;
+		u32 pos = hash & m_mask;
+		for (;;) {
+			const u32 empty = matchEmpty(ctrl + pos);
+			u32 match = matchTag(ctrl + pos, tag);
+			// keys can not be stored after the first empty slot
+			if (empty) match &= (empty & (0 - empty)) - 1;
+			while (match) {
+				const u32 idx = (pos + lowestBit(match)) & m_mask;
+				if (m_keys[idx] == key) return idx;
+				match &= match - 1;
+			}
+			if (empty) return m_capacity;
+			pos = (pos + GROUP_SIZE) & m_mask;
 		}
-		return m_capacity;
 	}
 
-	void init(u32 capacity, bool all_invalid) {
+	void init(u32 capacity) {
 		const bool is_pow_2 = capacity && !(capacity & (capacity - 1));
 		ASSERT(is_pow_2);
 		m_size = 0;
 		m_mask = capacity - 1;
-		m_keys = (Slot*)m_allocator.allocate(sizeof(Slot) * (capacity + 1));
+		m_ctrl = (u8*)m_allocator.allocate(capacity + GROUP_SIZE);
+		m_keys = (Key*)m_allocator.allocate(sizeof(Key) * capacity);
 		m_values = (Value*)m_allocator.allocate(sizeof(Value) * capacity);
 		m_capacity = capacity;
-		if (all_invalid) {
-			for(u32 i = 0; i < capacity; ++i) {
-				m_keys[i].valid = false;
-			}
-		}
-		m_keys[capacity].valid = false;
+		memset(m_ctrl, EMPTY, capacity + GROUP_SIZE);
 	}
 
 	IAllocator& m_allocator;
-	Slot* m_keys = nullptr;
+	u8* m_ctrl = nullptr;
+	Key* m_keys = nullptr;
 	Value* m_values = nullptr;
 	u32 m_capacity = 0;
 	u32 m_size = 0;
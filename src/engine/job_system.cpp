@@ -23,6 +23,63 @@ struct Job {
 
 struct WorkerTask;
 
+// counter bit set by waitEx when some fiber is parked on the signal
+// setGreen and decrements which do not drop a signal with waitors to zero never touch the global lock
+static constexpr i32 SIGNAL_HAS_WAITORS = 1 << 30;
+static constexpr i32 SIGNAL_COUNTER_MASK = SIGNAL_HAS_WAITORS - 1;
+
+// Chase-Lev work-stealing deque, owner pushes and pops at the bottom, other workers steal from the top
+// fixed capacity, jobs which do not fit are pushed to the global queue
+struct WorkStealingQueue {
+	enum { CAPACITY = 1024 };
+
+	bool push(const Job& job) {
+		const i64 bottom = m_bottom;
+		const i64 top = m_top;
+		if (bottom - top >= CAPACITY) return false;
+
+		m_jobs[bottom & (CAPACITY - 1)] = job;
+		memoryBarrier();
+		m_bottom = bottom + 1;
+		return true;
+	}
+
+	bool pop(Job& job) {
+		const i64 bottom = m_bottom - 1;
+		m_bottom = bottom;
+		memoryBarrier();
+		const i64 top = m_top;
+		if (top > bottom) {
+			m_bottom = top;
+			return false;
+		}
+
+		job = m_jobs[bottom & (CAPACITY - 1)];
+		if (top != bottom) return true;
+
+		// last job, race with thieves
+		const bool res = compareAndExchange64(&m_top, top + 1, top);
+		m_bottom = top + 1;
+		return res;
+	}
+
+	bool steal(Job& job) {
+		const i64 top = m_top;
+		memoryBarrier();
+		const i64 bottom = m_bottom;
+		if (top >= bottom) return false;
+
+		job = m_jobs[top & (CAPACITY - 1)];
+		return compareAndExchange64(&m_top, top + 1, top);
+	}
+
+	bool isEmpty() const { return m_bottom <= m_top; }
+
+	alignas(64) volatile i64 m_top = 0;
+	alignas(64) volatile i64 m_bottom = 0;
+	Job m_jobs[CAPACITY];
+};
+
 struct FiberDecl {
 	int idx;
 	Fiber::Handle fiber = Fiber::INVALID_FIBER;
@@ -44,6 +101,7 @@ struct System
 		, m_ready_fibers(allocator)
 		, m_free_fibers(allocator)
 		, m_backup_workers(allocator)
+		, m_sleeping_workers(allocator)
 	{}
 
 
@@ -51,10 +109,14 @@ struct System
 	Lumix::Mutex m_job_queue_sync;
 	Array<WorkerTask*> m_workers;
 	Array<WorkerTask*> m_backup_workers;
+	Array<WorkerTask*> m_sleeping_workers;
 	Array<Job> m_job_queue;
 	FiberDecl m_fiber_pool[512];
 	Array<FiberDecl*> m_free_fibers;
 	Array<FiberDecl*> m_ready_fibers;
+	// m_job_queue.size() + m_ready_fibers.size(), written with m_job_queue_sync locked, read without lock as a hint
+	volatile i32 m_num_queued = 0;
+	volatile i32 m_num_sleeping = 0;
 	IAllocator& m_allocator;
 };
 
@@ -112,11 +174,15 @@ struct WorkerTask : Thread
 	FiberDecl* m_current_fiber = nullptr;
 	Fiber::Handle m_primary_fiber;
 	System& m_system;
+	WorkStealingQueue m_work_queue;
+	// jobs and fibers pinned to this worker, protected by m_job_queue_sync
 	Array<Job> m_job_queue;
 	Array<FiberDecl*> m_ready_fibers;
+	volatile i32 m_num_pinned = 0;
 	u8 m_worker_index;
 	bool m_is_enabled = false;
 	bool m_is_backup = false;
+	bool m_is_sleeping = false;
 };
 
 struct Waitor {
@@ -124,52 +190,80 @@ struct Waitor {
 	FiberDecl* fiber;
 };
 
+// call with m_job_queue_sync locked
+static void wakeupWorker(WorkerTask* worker) {
+	if (!worker->m_is_sleeping) return;
+
+	worker->m_is_sleeping = false;
+	g_system->m_sleeping_workers.swapAndPopItem(worker);
+	atomicDecrement(&g_system->m_num_sleeping);
+	worker->wakeup();
+}
+
+// call with m_job_queue_sync locked
+static void wakeupAnyWorker() {
+	if (g_system->m_sleeping_workers.empty()) return;
+	wakeupWorker(g_system->m_sleeping_workers.back());
+}
+
 template <bool ZERO>
 LUMIX_FORCE_INLINE static bool trigger(Signal* signal)
 {
 	Waitor* waitor;
-	{
-		Lumix::MutexGuard lock(g_system->m_sync);
-
-		if constexpr (ZERO) {
-			signal->counter = 0;
-		}
-		else {
-			--signal->counter;
-			ASSERT(signal->counter >= 0);
-			if (signal->counter > 0) return false;
+	if constexpr (ZERO) {
+		for (;;) {
+			const i32 counter = signal->counter;
+			if (counter & SIGNAL_HAS_WAITORS) break;
+			if (compareAndExchange(&signal->counter, 0, counter)) return false;
 		}
 
+		// there are waitors, they can not be added or removed while we hold m_sync
+		Lumix::MutexGuard lock(g_system->m_sync);
 		waitor = signal->waitor;
 		signal->waitor = nullptr;
+		signal->counter = 0;
 	}
-	if (!waitor) return false;
+	else {
+		for (;;) {
+			const i32 counter = signal->counter;
+			ASSERT((counter & SIGNAL_COUNTER_MASK) > 0);
+			if ((counter & SIGNAL_HAS_WAITORS) && (counter & SIGNAL_COUNTER_MASK) == 1) break;
+			if (compareAndExchange(&signal->counter, counter - 1, counter)) return false;
+		}
 
-	bool wake_all = false;
-	{
-		Lumix::MutexGuard queue_lock(g_system->m_job_queue_sync);
-		while (waitor) {
-			Waitor* next = waitor->next;
-			const u8 worker = waitor->fiber->current_job.worker_index;
-			if (worker == ANY_WORKER) {
-				g_system->m_ready_fibers.push(waitor->fiber);
-				wake_all = true;
-			}
-			else {
-				WorkerTask* worker = g_system->m_workers[waitor->fiber->current_job.worker_index % g_system->m_workers.size()];
-				worker->m_ready_fibers.push(waitor->fiber);
-				if(!wake_all) worker->wakeup();
+		// last decrement and there are waitors, they can not be added or removed while we hold m_sync
+		Lumix::MutexGuard lock(g_system->m_sync);
+		for (;;) {
+			const i32 counter = signal->counter;
+			if ((counter & SIGNAL_COUNTER_MASK) > 1) {
+				if (compareAndExchange(&signal->counter, counter - 1, counter)) return false;
+				continue;
 			}
-			waitor = next;
+			waitor = signal->waitor;
+			signal->waitor = nullptr;
+			// signal can be destroyed as soon as the counter is zero, do not touch it after this
+			if (compareAndExchange(&signal->counter, 0, counter)) break;
+			signal->waitor = waitor;
 		}
 	}
-	if (wake_all) {
-		for (WorkerTask* worker : g_system->m_backup_workers) {
-			if (worker->m_is_enabled) worker->wakeup();
+	if (!waitor) return false;
+
+	Lumix::MutexGuard queue_lock(g_system->m_job_queue_sync);
+	while (waitor) {
+		Waitor* next = waitor->next;
+		const u8 worker_index = waitor->fiber->current_job.worker_index;
+		if (worker_index == ANY_WORKER) {
+			g_system->m_ready_fibers.push(waitor->fiber);
+			++g_system->m_num_queued;
+			wakeupAnyWorker();
 		}
-		for (WorkerTask* worker : g_system->m_workers) {
-			worker->wakeup();
+		else {
+			WorkerTask* worker = g_system->m_workers[worker_index % g_system->m_workers.size()];
+			worker->m_ready_fibers.push(waitor->fiber);
+			++worker->m_num_pinned;
+			wakeupWorker(worker);
 		}
+		waitor = next;
 	}
 	return true;
 }
@@ -181,6 +275,8 @@ void enableBackupWorker(bool enable)
 	for (WorkerTask* task : g_system->m_backup_workers) {
 		if (task->m_is_enabled != enable) {
 			task->m_is_enabled = enable;
+			// disabled backup workers sleep on m_sync, they are not in m_sleeping_workers
+			if (enable) task->wakeup();
 			return;
 		}
 	}
@@ -200,7 +296,7 @@ void enableBackupWorker(bool enable)
 
 LUMIX_FORCE_INLINE static bool setRedEx(Signal* signal) {
 	ASSERT(signal);
-	ASSERT(signal->counter <= 1);
+	ASSERT((signal->counter & SIGNAL_COUNTER_MASK) <= 1);
 	bool res = compareAndExchange(&signal->counter, 1, 0);
 	if (res) {
 		signal->generation = atomicIncrement(&g_generation);
@@ -214,7 +310,7 @@ void setRed(Signal* signal) {
 
 void setGreen(Signal* signal) {
 	ASSERT(signal);
-	ASSERT(signal->counter <= 1);
+	ASSERT((signal->counter & SIGNAL_COUNTER_MASK) <= 1);
 	const u32 gen = signal->generation;
 	if (trigger<true>(signal)){
 		profiler::signalTriggered(gen);
@@ -237,34 +333,108 @@ void runEx(void* data, void(*task)(void*), Signal* on_finished, u8 worker_index)
 	job.dec_on_finish = on_finished;
 
 	if (on_finished) {
-		Lumix::MutexGuard guard(g_system->m_sync);
-		++on_finished->counter;
-		if (on_finished->counter == 1) {
+		if (atomicIncrement(&on_finished->counter) == 1) {
 			on_finished->generation = atomicIncrement(&g_generation);
 		}
 	}
 
 	if (worker_index != ANY_WORKER) {
 		WorkerTask* worker = g_system->m_workers[worker_index % g_system->m_workers.size()];
-		{
+		Lumix::MutexGuard lock(g_system->m_job_queue_sync);
+		worker->m_job_queue.push(job);
+		++worker->m_num_pinned;
+		wakeupWorker(worker);
+		return;
+	}
+
+	WorkerTask* worker = getWorker();
+	if (worker && !worker->m_is_backup && worker->m_work_queue.push(job)) {
+		// pairs with atomicIncrement(&m_num_sleeping) in manage, either we see the sleeper or it sees the job
+		memoryBarrier();
+		if (g_system->m_num_sleeping > 0) {
 			Lumix::MutexGuard lock(g_system->m_job_queue_sync);
-			worker->m_job_queue.push(job);
+			wakeupAnyWorker();
 		}
-		worker->wakeup();
 		return;
 	}
 
-	{
-		Lumix::MutexGuard lock(g_system->m_job_queue_sync);
-		g_system->m_job_queue.push(job);
+	Lumix::MutexGuard lock(g_system->m_job_queue_sync);
+	g_system->m_job_queue.push(job);
+	++g_system->m_num_queued;
+	wakeupAnyWorker();
+}
+
+
+// call with m_job_queue_sync locked
+static bool hasWork(WorkerTask* worker) {
+	if (!worker->m_ready_fibers.empty() || !worker->m_job_queue.empty()) return true;
+	if (!g_system->m_ready_fibers.empty() || !g_system->m_job_queue.empty()) return true;
+	for (WorkerTask* w : g_system->m_workers) {
+		if (!w->m_work_queue.isEmpty()) return true;
 	}
+	return false;
+}
+
 
-	for (WorkerTask* worker : g_system->m_workers) {
-		worker->wakeup();
+static bool popPinned(WorkerTask* worker, FiberDecl*& fiber, Job& job) {
+	if (worker->m_num_pinned == 0) return false;
+
+	Lumix::MutexGuard lock(g_system->m_job_queue_sync);
+	if (!worker->m_ready_fibers.empty()) {
+		fiber = worker->m_ready_fibers.back();
+		worker->m_ready_fibers.pop();
+		--worker->m_num_pinned;
+		return true;
 	}
-	for (WorkerTask* worker : g_system->m_backup_workers) {
-		if (worker->m_is_enabled) worker->wakeup();
+	if (!worker->m_job_queue.empty()) {
+		job = worker->m_job_queue.back();
+		worker->m_job_queue.pop();
+		--worker->m_num_pinned;
+		return true;
 	}
+	return false;
+}
+
+
+static bool popGlobal(bool fibers_only, FiberDecl*& fiber, Job& job) {
+	if (g_system->m_num_queued == 0) return false;
+
+	Lumix::MutexGuard lock(g_system->m_job_queue_sync);
+	if (!g_system->m_ready_fibers.empty()) {
+		fiber = g_system->m_ready_fibers.back();
+		g_system->m_ready_fibers.pop();
+		--g_system->m_num_queued;
+		return true;
+	}
+	if (!fibers_only && !g_system->m_job_queue.empty()) {
+		job = g_system->m_job_queue.back();
+		g_system->m_job_queue.pop();
+		--g_system->m_num_queued;
+		return true;
+	}
+	return false;
+}
+
+
+static bool steal(WorkerTask* worker, Job& job) {
+	const u32 count = g_system->m_workers.size();
+	const u32 offset = worker->m_is_backup ? 0 : worker->m_worker_index + 1;
+	for (u32 i = 0; i < count; ++i) {
+		WorkerTask* victim = g_system->m_workers[(offset + i) % count];
+		if (victim == worker) continue;
+		if (victim->m_work_queue.steal(job)) return true;
+	}
+	return false;
+}
+
+
+// order: pinned, resumable fibers, own deque, global queue, other workers' deques
+static bool getWork(WorkerTask* worker, FiberDecl*& fiber, Job& job) {
+	if (popPinned(worker, fiber, job)) return true;
+	if (popGlobal(true, fiber, job)) return true;
+	if (!worker->m_is_backup && worker->m_work_queue.pop(job)) return true;
+	if (popGlobal(false, fiber, job)) return true;
+	return steal(worker, job);
 }
 
 
@@ -292,34 +462,29 @@ void runEx(void* data, void(*task)(void*), Signal* on_finished, u8 worker_index)
 		FiberDecl* fiber = nullptr;
 		Job job;
 		while (!worker->m_finished) {
-			Lumix::MutexGuard lock(g_system->m_job_queue_sync);
+			if (getWork(worker, fiber, job)) break;
 
-			if (!worker->m_ready_fibers.empty()) {
-				fiber = worker->m_ready_fibers.back();
-				worker->m_ready_fibers.pop();
-				break;
-			}
-			if (!worker->m_job_queue.empty()) {
-				job = worker->m_job_queue.back();
-				worker->m_job_queue.pop();
-				break;
-			}
-			if (!g_system->m_ready_fibers.empty()) {
-				fiber = g_system->m_ready_fibers.back();
-				g_system->m_ready_fibers.pop();
-				break;
-			}
-			if(!g_system->m_job_queue.empty()) {
-				job = g_system->m_job_queue.back();
-				g_system->m_job_queue.pop();
-				break;
+			Lumix::MutexGuard lock(g_system->m_job_queue_sync);
+			worker->m_is_sleeping = true;
+			g_system->m_sleeping_workers.push(worker);
+			atomicIncrement(&g_system->m_num_sleeping);
+			if (hasWork(worker)) {
+				wakeupWorker(worker);
+				continue;
 			}
 
 			PROFILE_BLOCK("sleeping");
 			profiler::blockColor(0x30, 0x30, 0x30);
-			worker->sleep(g_system->m_job_queue_sync);
+			while (worker->m_is_sleeping && !worker->m_finished) {
+				worker->sleep(g_system->m_job_queue_sync);
+			}
+			if (worker->m_is_sleeping) wakeupWorker(worker);
 			
-			if (worker->m_is_backup) break;
+			if (worker->m_is_backup) {
+				// we might have consumed a wakeup meant for a job we are not going to run
+				if (!worker->m_is_enabled) wakeupAnyWorker();
+				break;
+			}
 		}
 		if (worker->m_finished) break;
 
@@ -373,7 +538,7 @@ bool init(u8 workers_count, IAllocator& allocator)
 
 	int count = maximum(1, int(workers_count));
 	for (int i = 0; i < count; ++i) {
-		WorkerTask* task = LUMIX_NEW(allocator, WorkerTask)(*g_system, i < 64 ? u64(1) << i : 0);
+		WorkerTask* task = LUMIX_NEW(allocator, WorkerTask)(*g_system, i);
 		if (task->create("Worker", false)) {
 			task->m_is_enabled = true;
 			g_system->m_workers.push(task);
@@ -444,11 +609,6 @@ static void waitEx(Signal* signal, bool is_mutex)
 	if (signal->counter == 0) return;
 
 	g_system->m_sync.enter();
-	if (signal->counter == 0) {
-		g_system->m_sync.exit();
-		return;
-	}
-	
 	if (!getWorker()) {
 		while (signal->counter > 0) {
 			g_system->m_sync.exit();
@@ -459,6 +619,16 @@ static void waitEx(Signal* signal, bool is_mutex)
 		return;
 	}
 
+	for (;;) {
+		const i32 counter = signal->counter;
+		if (counter == 0) {
+			g_system->m_sync.exit();
+			return;
+		}
+		if (counter & SIGNAL_HAS_WAITORS) break;
+		if (compareAndExchange(&signal->counter, counter | SIGNAL_HAS_WAITORS, counter)) break;
+	}
+
 	FiberDecl* this_fiber = getWorker()->m_current_fiber;
 
 	Waitor waitor;
@@ -483,7 +653,9 @@ void enter(Mutex* mutex) {
 	ASSERT(getWorker());
 	for (;;) {
 		for (u32 i = 0; i < 400; ++i) {
-			if (setRedEx(&mutex->signal)) return;
+			// do not hammer the cache line with CAS while the mutex is locked
+			if (mutex->signal.counter == 0 && setRedEx(&mutex->signal)) return;
+			cpuRelax();
 		}
 		waitEx(&mutex->signal, true);
 	}
@@ -498,4 +670,103 @@ void wait(Signal* handle) {
 	waitEx(handle, false);
 }
 
+void radixSort(u64* _keys, u64* _values, int size) {
+	PROFILE_FUNCTION();
+	profiler::pushInt("count", size);
+	if (size == 0) return;
+
+	static constexpr u32 BITS = 11;
+	static constexpr u32 HISTOGRAM_SIZE = 1 << BITS;
+	static constexpr u32 BIT_MASK = HISTOGRAM_SIZE - 1;
+	static constexpr i32 MIN_BLOCK_SIZE = 4096;
+
+	// fixed blocks, each block has its own histogram, so each block can scatter its keys independently and the sort stays stable
+	const i32 workers_count = getWorkersCount();
+	const i32 block_size = maximum(MIN_BLOCK_SIZE, (size + workers_count - 1) / workers_count);
+	const i32 block_count = (size + block_size - 1) / block_size;
+
+	IAllocator& allocator = getAllocator();
+	Array<u32> histograms(allocator);
+	Array<u8> sorted(allocator);
+	Array<u64> tmp_mem(allocator);
+	histograms.resize(block_count * HISTOGRAM_SIZE);
+	sorted.resize(block_count);
+
+	u64* keys = _keys;
+	u64* values = _values;
+	u64* tmp_keys = nullptr;
+	u64* tmp_values = nullptr;
+	u16 shift = 0;
+
+	for (int pass = 0; pass < 6; ++pass) {
+		jobs::forEach(size, block_size, [&](i32 begin, i32 end){
+			PROFILE_BLOCK("compute histogram");
+			const i32 block = begin / block_size;
+			u32* histogram = &histograms[block * HISTOGRAM_SIZE];
+			memset(histogram, 0, HISTOGRAM_SIZE * sizeof(histogram[0]));
+
+			bool is_sorted = true;
+			u64 prev_key = begin > 0 ? keys[begin - 1] : keys[0];
+			for (i32 i = begin; i < end; ++i) {
+				const u64 key = keys[i];
+				++histogram[(key >> shift) & BIT_MASK];
+				is_sorted &= prev_key <= key;
+				prev_key = key;
+			}
+			sorted[block] = is_sorted;
+		});
+
+		bool all_sorted = true;
+		for (u8 s : sorted) all_sorted = all_sorted && s;
+		if (all_sorted) break;
+
+		// turn counts into per-block destination offsets
+		u32 offset = 0;
+		bool skip_pass = false;
+		for (u32 i = 0; i < HISTOGRAM_SIZE; ++i) {
+			const u32 digit_start = offset;
+			for (i32 block = 0; block < block_count; ++block) {
+				u32& h = histograms[block * HISTOGRAM_SIZE + i];
+				const u32 count = h;
+				h = offset;
+				offset += count;
+			}
+			// all keys have the same digit, the pass would not change anything
+			if (offset - digit_start == (u32)size) {
+				skip_pass = true;
+				break;
+			}
+		}
+
+		if (!skip_pass) {
+			if (!tmp_keys) {
+				tmp_mem.resize(size * 2);
+				tmp_keys = tmp_mem.begin();
+				tmp_values = &tmp_mem[size];
+			}
+
+			jobs::forEach(size, block_size, [&](i32 begin, i32 end){
+				PROFILE_BLOCK("scatter");
+				u32* histogram = &histograms[begin / block_size * HISTOGRAM_SIZE];
+				for (i32 i = begin; i < end; ++i) {
+					const u64 key = keys[i];
+					const u32 dest = histogram[(key >> shift) & BIT_MASK]++;
+					tmp_keys[dest] = key;
+					tmp_values[dest] = values[i];
+				}
+			});
+
+			swap(tmp_keys, keys);
+			swap(tmp_values, values);
+		}
+
+		shift += BITS;
+	}
+
+	if (keys != _keys) {
+		memcpy(_keys, keys, size * sizeof(keys[0]));
+		memcpy(_values, values, size * sizeof(values[0]));
+	}
+}
+
 } // namespace Lumix::jobs
@@ -29,6 +29,10 @@ LUMIX_ENGINE_API void run(void* data, void(*task)(void*), Signal* on_finish);
 LUMIX_ENGINE_API void runEx(void* data, void (*task)(void*), Signal* on_finish, u8 worker_index);
 LUMIX_ENGINE_API void wait(Signal* signal);
 
+// stable LSD radix sort of keys, values are reordered together with keys
+// histograms and scatter run in parallel on all workers, must be called from a worker
+LUMIX_ENGINE_API void radixSort(u64* keys, u64* values, int size);
+
 template <typename F>
 void runLambda(F&& f, Signal* on_finish, u8 worker = ANY_WORKER) {
 	void* arg;
@@ -97,7 +101,7 @@ struct Signal {
 	~Signal() { ASSERT(!waitor); ASSERT(!counter); }
 
 	struct Waitor* waitor = nullptr;
-	volatile i32 counter = 0;
+	volatile i32 counter = 0; // bit 30 is set while there are waitors
 	i32 generation; // identify different red-green pairs on the same signal, used by profiler
 };
 
@@ -46,4 +46,14 @@ LUMIX_ENGINE_API void memoryBarrier()
 }
 
 
+LUMIX_ENGINE_API void cpuRelax()
+{
+#if defined __i386__ || defined __x86_64__
+	__builtin_ia32_pause();
+#elif defined __aarch64__ || defined __arm__
+	__asm__ __volatile__("yield");
+#endif
+}
+
+
 } // namespace Lumix
@@ -1,9 +1,9 @@
 #include "engine/fibers.h"
 #include "engine/lumix.h"
 #include "engine/profiler.h"
-#include <ucontext.h>
-#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 namespace Lumix
 {
@@ -13,55 +13,201 @@ namespace Fiber
 {
 
 
-thread_local Handle g_finisher;
+// lives at the top of the fiber's stack mapping
+struct Context {
+	void* sp;
+	void* mapping;
+	size_t mapping_size;
+	FiberProc proc;
+	void* parameter;
+};
+
+
+} // namespace Fiber
+
+
+} // namespace Lumix
+
+
+// saves callee-saved registers on the current stack, stores stack pointer to *from_sp and restores registers from to_sp
+extern "C" void lumix_fiber_switch(void** from_sp, void* to_sp);
+// first return address of a new fiber, moves the context from a callee-saved register to the first argument
+extern "C" void lumix_fiber_entry();
+
+extern "C" __attribute__((visibility("hidden"), used, noreturn)) void lumix_fiber_start(Lumix::Fiber::Context* ctx)
+{
+	ctx->proc(ctx->parameter);
+	// fiber procs must switch away instead of returning, there is nothing to return to
+	ASSERT(false);
+	__builtin_trap();
+}
+
+
+#if defined __x86_64__
+	// stack: mxcsr + x87 control word, r15, r14, r13, r12, rbx, rbp, return address
+	asm(R"(
+		.text
+		.globl lumix_fiber_switch
+		.hidden lumix_fiber_switch
+		.type lumix_fiber_switch, @function
+	lumix_fiber_switch:
+		pushq %rbp
+		pushq %rbx
+		pushq %r12
+		pushq %r13
+		pushq %r14
+		pushq %r15
+		subq $8, %rsp
+		stmxcsr (%rsp)
+		fnstcw 4(%rsp)
+		movq %rsp, (%rdi)
+		movq %rsi, %rsp
+		ldmxcsr (%rsp)
+		fldcw 4(%rsp)
+		addq $8, %rsp
+		popq %r15
+		popq %r14
+		popq %r13
+		popq %r12
+		popq %rbx
+		popq %rbp
+		ret
+		.size lumix_fiber_switch, .-lumix_fiber_switch
+
+		.globl lumix_fiber_entry
+		.hidden lumix_fiber_entry
+		.type lumix_fiber_entry, @function
+	lumix_fiber_entry:
+		movq %rbx, %rdi
+		call lumix_fiber_start
+		ud2
+		.size lumix_fiber_entry, .-lumix_fiber_entry
+	)");
+
+	enum { SWITCH_FRAME_SIZE = 64, FRAME_CTX_OFFSET = 40, FRAME_RET_OFFSET = 56 };
+#elif defined __aarch64__
+	// stack: x19 - x28, fp, lr, d8 - d15
+	asm(R"(
+		.text
+		.globl lumix_fiber_switch
+		.hidden lumix_fiber_switch
+		.type lumix_fiber_switch, %function
+	lumix_fiber_switch:
+		sub sp, sp, #160
+		stp x19, x20, [sp, #0]
+		stp x21, x22, [sp, #16]
+		stp x23, x24, [sp, #32]
+		stp x25, x26, [sp, #48]
+		stp x27, x28, [sp, #64]
+		stp x29, x30, [sp, #80]
+		stp d8, d9, [sp, #96]
+		stp d10, d11, [sp, #112]
+		stp d12, d13, [sp, #128]
+		stp d14, d15, [sp, #144]
+		mov x9, sp
+		str x9, [x0]
+		mov sp, x1
+		ldp x19, x20, [sp, #0]
+		ldp x21, x22, [sp, #16]
+		ldp x23, x24, [sp, #32]
+		ldp x25, x26, [sp, #48]
+		ldp x27, x28, [sp, #64]
+		ldp x29, x30, [sp, #80]
+		ldp d8, d9, [sp, #96]
+		ldp d10, d11, [sp, #112]
+		ldp d12, d13, [sp, #128]
+		ldp d14, d15, [sp, #144]
+		add sp, sp, #160
+		ret
+		.size lumix_fiber_switch, .-lumix_fiber_switch
+
+		.globl lumix_fiber_entry
+		.hidden lumix_fiber_entry
+		.type lumix_fiber_entry, %function
+	lumix_fiber_entry:
+		mov x0, x19
+		bl lumix_fiber_start
+		brk #0
+		.size lumix_fiber_entry, .-lumix_fiber_entry
+	)");
+
+	enum { SWITCH_FRAME_SIZE = 160, FRAME_CTX_OFFSET = 0, FRAME_RET_OFFSET = 88 };
+#else
+	#error Unsupported platform
+#endif
+
+
+namespace Lumix
+{
+
+
+namespace Fiber
+{
+
+
+// context of the thread's own stack, threads are converted to fibers in initThread
+thread_local Context g_thread_context = {};
 
 
 void initThread(FiberProc proc, Handle* out)
 {
-	*out = create(64*1024, proc, nullptr);
-	getcontext(&g_finisher);
-	out->uc_link = &g_finisher;
-	switchTo(&g_finisher, *out);
+	*out = &g_thread_context;
+	proc(nullptr);
 }
 
 
 Handle create(int stack_size, FiberProc proc, void* parameter)
 {
-	ucontext_t fib;
-	getcontext(&fib);
-    fib.uc_stack.ss_sp = (::malloc)(stack_size);
-    fib.uc_stack.ss_size = stack_size;
-    fib.uc_link = 0;
-    makecontext(&fib, (void(*)())proc, 1, parameter); 
-	return fib;
+	const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+	const size_t stack_bytes = ((size_t)stack_size + page_size - 1) & ~(page_size - 1);
+	// one guard page below the stack, overflow segfaults instead of silently corrupting memory
+	const size_t mapping_size = stack_bytes + page_size;
+	void* mapping = mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+	if (mapping == MAP_FAILED) return INVALID_FIBER;
+	mprotect(mapping, page_size, PROT_NONE);
+
+	u8* top = (u8*)mapping + mapping_size;
+	Context* ctx = (Context*)(top - sizeof(Context));
+	ctx->mapping = mapping;
+	ctx->mapping_size = mapping_size;
+	ctx->proc = proc;
+	ctx->parameter = parameter;
+
+	// 16 bytes of padding keep the stack aligned as if lumix_fiber_entry was called
+	u8* sp = (u8*)(uintptr(ctx) & ~uintptr(15)) - SWITCH_FRAME_SIZE - 16;
+	memset(sp, 0, SWITCH_FRAME_SIZE);
+	#ifdef __x86_64__
+		*(u32*)sp = 0x1F80; // default mxcsr
+		*(u16*)(sp + 4) = 0x037F; // default x87 control word
+	#endif
+	*(Context**)(sp + FRAME_CTX_OFFSET) = ctx;
+	*(void**)(sp + FRAME_RET_OFFSET) = (void*)&lumix_fiber_entry;
+	ctx->sp = sp;
+	return ctx;
 }
 
+
 bool isValid(Handle handle)
 {
-	return handle.uc_stack.ss_sp != nullptr;
+	return handle != INVALID_FIBER;
 }
 
+
 void destroy(Handle fiber)
 {
-	ASSERT(false);
+	ASSERT(fiber != &g_thread_context);
+	munmap(fiber->mapping, fiber->mapping_size);
 }
 
 
-void switchTo(Handle* prev, Handle fiber)
+void switchTo(Handle* from, Handle fiber)
 {
 	profiler::beforeFiberSwitch();
-	swapcontext(prev, &fiber); 
-}
-
-
-void* getParameter()
-{
-	ASSERT(false);
-	return nullptr;
+	lumix_fiber_switch(&(*from)->sp, fiber->sp);
 }
 
 
 } // namespace Fibers
 
 
-} // namespace Lumix
\ No newline at end of file
+} // namespace Lumix
@@ -916,6 +916,29 @@ void memRelease(void* ptr, size_t size) {
 	munmap(ptr, size);
 }
 
+const void* mapFile(const char* path, u64& size) {
+	const int fd = ::open(path, O_RDONLY);
+	if (fd < 0) return nullptr;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		::close(fd);
+		return nullptr;
+	}
+
+	void* mem = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// mapping keeps its own reference to the file
+	::close(fd);
+	if (mem == MAP_FAILED) return nullptr;
+
+	size = st.st_size;
+	return mem;
+}
+
+void unmapFile(const void* ptr, u64 size) {
+	munmap((void*)ptr, size);
+}
+
 struct FileIterator {};
 
 FileIterator* createFileIterator(const char* path, IAllocator& allocator) {
@@ -168,6 +168,9 @@ LUMIX_ENGINE_API void memRelease(void* ptr, size_t size); // size must be full s
 LUMIX_ENGINE_API u32 getMemPageSize();
 LUMIX_ENGINE_API u32 getMemPageAlignment();
 LUMIX_ENGINE_API u64 getProcessMemory();
+// read-only mapping of a whole file, nullptr on failure
+[[nodiscard]] LUMIX_ENGINE_API const void* mapFile(const char* path, u64& size);
+LUMIX_ENGINE_API void unmapFile(const void* ptr, u64 size);
 
 LUMIX_ENGINE_API FileIterator* createFileIterator(const char* path, IAllocator& allocator);
 LUMIX_ENGINE_API void destroyFileIterator(FileIterator* iterator);
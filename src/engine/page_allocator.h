@@ -1,6 +1,7 @@
 #pragma once
 
 
+#include "allocator.h"
 #include "atomic.h"
 #include "sync.h"
 
@@ -4,8 +4,16 @@
 #include "engine/lumix.h"
 
 
-#ifdef _WIN32
-	#include <xmmintrin.h>
+#if defined _WIN32 || defined __SSE2__
+	#define LUMIX_SIMD_SSE
+	#ifdef __AVX2__
+		#define LUMIX_SIMD_AVX2
+		#include <immintrin.h>
+	#elif defined __SSE4_1__
+		#include <smmintrin.h>
+	#else
+		#include <emmintrin.h>
+	#endif
 #else
 	#include <math.h>
 	#include <string.h>
@@ -15,7 +23,7 @@ namespace Lumix
 {
 
 
-#ifdef _WIN32
+#ifdef LUMIX_SIMD_SSE
 	using float4 = __m128;
 
 
@@ -133,17 +141,115 @@ namespace Lumix
 		return _mm_max_ps(a, b);
 	}
 
-	LUMIX_FORCE_INLINE float4 operator +(float4 a, float4 b) {
-		return _mm_add_ps(a, b);
-	}
 
-	LUMIX_FORCE_INLINE float4 operator -(float4 a, float4 b) {
-		return _mm_sub_ps(a, b);
+	// rows to columns
+	LUMIX_FORCE_INLINE void f4Transpose(float4& a, float4& b, float4& c, float4& d)
+	{
+		_MM_TRANSPOSE4_PS(a, b, c, d);
 	}
 
-	LUMIX_FORCE_INLINE float4 operator *(float4 a, float4 b) {
-		return _mm_mul_ps(a, b);
-	}
+	// gcc and clang have builtin arithmetic operators for vector types
+	#if defined _MSC_VER && !defined __clang__
+		LUMIX_FORCE_INLINE float4 operator +(float4 a, float4 b) {
+			return _mm_add_ps(a, b);
+		}
+
+		LUMIX_FORCE_INLINE float4 operator -(float4 a, float4 b) {
+			return _mm_sub_ps(a, b);
+		}
+
+		LUMIX_FORCE_INLINE float4 operator *(float4 a, float4 b) {
+			return _mm_mul_ps(a, b);
+		}
+	#endif
+
+	#ifdef LUMIX_SIMD_AVX2
+		using float8 = __m256;
+
+
+		LUMIX_FORCE_INLINE float8 f8LoadUnaligned(const void* src)
+		{
+			return _mm256_loadu_ps((const float*)(src));
+		}
+
+
+		LUMIX_FORCE_INLINE float8 f8Load(const void* src)
+		{
+			return _mm256_load_ps((const float*)(src));
+		}
+
+
+		LUMIX_FORCE_INLINE float8 f8Splat(float value)
+		{
+			return _mm256_set1_ps(value);
+		}
+
+
+		LUMIX_FORCE_INLINE void f8Store(void* dest, float8 src)
+		{
+			_mm256_store_ps((float*)dest, src);
+		}
+
+
+		LUMIX_FORCE_INLINE float8 f8CmpGT(float8 a, float8 b)
+		{
+			return _mm256_cmp_ps(a, b, _CMP_GT_OQ);
+		}
+
+
+		LUMIX_FORCE_INLINE float8 f8CmpLT(float8 a, float8 b)
+		{
+			return _mm256_cmp_ps(a, b, _CMP_LT_OQ);
+		}
+
+
+		LUMIX_FORCE_INLINE int f8MoveMask(float8 a)
+		{
+			return _mm256_movemask_ps(a);
+		}
+
+
+		LUMIX_FORCE_INLINE float8 f8Add(float8 a, float8 b)
+		{
+			return _mm256_add_ps(a, b);
+		}
+
+
+		LUMIX_FORCE_INLINE float8 f8Sub(float8 a, float8 b)
+		{
+			return _mm256_sub_ps(a, b);
+		}
+
+
+		LUMIX_FORCE_INLINE float8 f8Mul(float8 a, float8 b)
+		{
+			return _mm256_mul_ps(a, b);
+		}
+
+
+		LUMIX_FORCE_INLINE float8 f8Div(float8 a, float8 b)
+		{
+			return _mm256_div_ps(a, b);
+		}
+
+
+		LUMIX_FORCE_INLINE float8 f8Sqrt(float8 a)
+		{
+			return _mm256_sqrt_ps(a);
+		}
+
+
+		LUMIX_FORCE_INLINE float8 f8Min(float8 a, float8 b)
+		{
+			return _mm256_min_ps(a, b);
+		}
+
+
+		LUMIX_FORCE_INLINE float8 f8Max(float8 a, float8 b)
+		{
+			return _mm256_max_ps(a, b);
+		}
+	#endif
 
 #else 
 	struct float4
@@ -337,6 +443,16 @@ namespace Lumix
 		};
 	}
 
+
+	LUMIX_FORCE_INLINE void f4Transpose(float4& a, float4& b, float4& c, float4& d)
+	{
+		const float4 ta = a, tb = b, tc = c, td = d;
+		a = {ta.x, tb.x, tc.x, td.x};
+		b = {ta.y, tb.y, tc.y, td.y};
+		c = {ta.z, tb.z, tc.z, td.z};
+		d = {ta.w, tb.w, tc.w, td.w};
+	}
+
 	LUMIX_FORCE_INLINE float4 operator +(float4 a, float4 b) {
 		return f4Add(a, b);
 	}
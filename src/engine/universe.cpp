@@ -52,11 +52,13 @@ Universe::Universe(Engine& engine, IAllocator& allocator)
 	, m_component_destroyed(m_allocator)
 	, m_entity_destroyed(m_allocator)
 	, m_entity_moved(m_allocator)
+	, m_entities_moved(m_allocator)
 	, m_entity_created(m_allocator)
 	, m_first_free_slot(-1)
 	, m_scenes(m_allocator)
 	, m_hierarchy(m_allocator)
 	, m_transforms(m_allocator)
+	, m_moved_scratch(m_allocator)
 	, m_name("")
 {
 	m_entities.reserve(RESERVED_ENTITIES_COUNT);
@@ -119,27 +121,50 @@ const Quat& Universe::getRotation(EntityRef entity) const
 void Universe::transformEntity(EntityRef entity, bool update_local)
 {
 	const int hierarchy_idx = m_entities[entity.index].hierarchy;
-	m_entity_moved.invoke(entity);
-	if (hierarchy_idx >= 0) {
-		Hierarchy& h = m_hierarchy[hierarchy_idx];
-		const Transform my_transform = getTransform(entity);
-		if (update_local && h.parent.isValid()) {
-			const Transform parent_tr = getTransform((EntityRef)h.parent);
-			h.local_transform = (parent_tr.inverted() * my_transform);
-		}
+	if (hierarchy_idx < 0) {
+		m_entity_moved.invoke(entity);
+		m_entities_moved.invoke(Span<const EntityRef>(&entity, 1));
+		return;
+	}
 
-		EntityPtr child = h.first_child;
-		while (child.isValid())
-		{
-			const Hierarchy& child_h = m_hierarchy[m_entities[child.index].hierarchy];
-			const Transform abs_tr = my_transform * child_h.local_transform;
-			Transform& child_data = m_transforms[child.index];
-			child_data = abs_tr;
-			transformEntity((EntityRef)child, false);
+	Hierarchy& h = m_hierarchy[hierarchy_idx];
+	if (update_local && h.parent.isValid()) {
+		const Transform parent_tr = getTransform((EntityRef)h.parent);
+		h.local_transform = (parent_tr.inverted() * getTransform(entity));
+	}
+
+	if (!h.first_child.isValid()) {
+		m_entity_moved.invoke(entity);
+		m_entities_moved.invoke(Span<const EntityRef>(&entity, 1));
+		return;
+	}
+
+	// listeners can move entities too, nested calls can not reuse the scratch array
+	Array<EntityRef> nested(m_allocator);
+	Array<EntityRef>& moved = m_moved_scratch.empty() ? m_moved_scratch : nested;
 
+	// breadth-first, parents are always updated before their children
+	moved.push(entity);
+	for (u32 i = 0; i < (u32)moved.size(); ++i) {
+		const EntityRef parent = moved[i];
+		const int parent_hierarchy_idx = m_entities[parent.index].hierarchy;
+		if (parent_hierarchy_idx < 0) continue;
+
+		const Transform parent_tr = m_transforms[parent.index];
+		EntityPtr child = m_hierarchy[parent_hierarchy_idx].first_child;
+		while (child.isValid()) {
+			const Hierarchy& child_h = m_hierarchy[m_entities[child.index].hierarchy];
+			m_transforms[child.index] = parent_tr * child_h.local_transform;
+			moved.push((EntityRef)child);
 			child = child_h.next_sibling;
 		}
 	}
+
+	if (!m_entity_moved.empty()) {
+		for (EntityRef e : moved) m_entity_moved.invoke(e);
+	}
+	m_entities_moved.invoke(moved);
+	moved.clear();
 }
 
 
@@ -169,7 +194,8 @@ void Universe::setTransformKeepChildren(EntityRef entity, const Transform& trans
 	tmp = transform;
 	
 	int hierarchy_idx = m_entities[entity.index].hierarchy;
-	entityTransformed().invoke(entity);
+	m_entity_moved.invoke(entity);
+	m_entities_moved.invoke(Span<const EntityRef>(&entity, 1));
 	if (hierarchy_idx >= 0)
 	{
 		Hierarchy& h = m_hierarchy[hierarchy_idx];
@@ -113,7 +113,11 @@ struct LUMIX_ENGINE_API Universe {
 	void setName(const char* name);
 
 	DelegateList<void(EntityRef)>& entityCreated() { return m_entity_created; }
+	// called for each moved entity, kept for listeners which handle entities one by one;
+	// a listener should bind either this or entitiesTransformed, not both
 	DelegateList<void(EntityRef)>& entityTransformed() { return m_entity_moved; }
+	// called once per moved subtree, parents precede their children
+	DelegateList<void(Span<const EntityRef>)>& entitiesTransformed() { return m_entities_moved; }
 	DelegateList<void(EntityRef)>& entityDestroyed() { return m_entity_destroyed; }
 	DelegateList<void(const ComponentUID&)>& componentDestroyed() { return m_component_destroyed; }
 	DelegateList<void(const ComponentUID&)>& componentAdded() { return m_component_added; }
@@ -158,8 +162,10 @@ private:
 	Array<EntityData> m_entities;
 	Array<Hierarchy> m_hierarchy;
 	Array<EntityName> m_names;
+	Array<EntityRef> m_moved_scratch;
 	DelegateList<void(EntityRef)> m_entity_created;
 	DelegateList<void(EntityRef)> m_entity_moved;
+	DelegateList<void(Span<const EntityRef>)> m_entities_moved;
 	DelegateList<void(EntityRef)> m_entity_destroyed;
 	DelegateList<void(const ComponentUID&)> m_component_destroyed;
 	DelegateList<void(const ComponentUID&)> m_component_added;
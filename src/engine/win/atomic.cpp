@@ -55,4 +55,14 @@ LUMIX_ENGINE_API void memoryBarrier()
 }
 
 
+LUMIX_ENGINE_API void cpuRelax()
+{
+#if defined _M_ARM || defined _M_ARM64
+	__yield();
+#else
+	_mm_pause();
+#endif
+}
+
+
 } // namespace Lumix
@@ -856,6 +856,33 @@ void memRelease(void* ptr, size_t size) {
 	VirtualFree(ptr, 0, MEM_RELEASE);
 }
 
+const void* mapFile(const char* path, u64& size) {
+	const HANDLE file = ::CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return nullptr;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+		CloseHandle(file);
+		return nullptr;
+	}
+
+	const HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	CloseHandle(file);
+	if (!mapping) return nullptr;
+
+	void* mem = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	// view keeps its own reference to the mapping
+	CloseHandle(mapping);
+	if (!mem) return nullptr;
+
+	size = file_size.QuadPart;
+	return mem;
+}
+
+void unmapFile(const void* ptr, u64 size) {
+	UnmapViewOfFile(ptr);
+}
+
 struct FileIterator
 {
 	HANDLE handle;
@@ -92,13 +92,13 @@ struct NavigationSceneImpl final : NavigationScene
 		, m_script_scene(nullptr)
 		, m_on_update(m_allocator)
 	{
-		m_universe.entityTransformed().bind<&NavigationSceneImpl::onEntityMoved>(this);
+		m_universe.entitiesTransformed().bind<&NavigationSceneImpl::onEntitiesMoved>(this);
 	}
 
 
 	~NavigationSceneImpl()
 	{
-		m_universe.entityTransformed().unbind<&NavigationSceneImpl::onEntityMoved>(this);
+		m_universe.entitiesTransformed().unbind<&NavigationSceneImpl::onEntitiesMoved>(this);
 	}
 
 
@@ -112,6 +112,12 @@ struct NavigationSceneImpl final : NavigationScene
 	}
 
 
+	void onEntitiesMoved(Span<const EntityRef> entities)
+	{
+		for (EntityRef e : entities) onEntityMoved(e);
+	}
+
+
 	void onEntityMoved(EntityRef entity)
 	{
 		auto iter = m_agents.find(entity);
@@ -44,6 +44,7 @@ struct CellIndicesHasher
 };
 
 
+// spheres are stored as separate arrays, so culling tests several spheres at once
 struct alignas(4096) CellPage {
 	struct {
 		CellPage* next = nullptr;
@@ -53,13 +54,56 @@ struct alignas(4096) CellPage {
 		int count = 0;
 	} header;
 
-	enum { MAX_COUNT = (PageAllocator::PAGE_SIZE - sizeof(header)) / (sizeof(Sphere) + sizeof(EntityPtr)) };
+	// multiple of 8 keeps all arrays aligned for 8-wide loads, culling reads up to the next multiple of 8
+	enum { MAX_COUNT = ((PageAllocator::PAGE_SIZE - 64) / (4 * sizeof(float) + sizeof(EntityPtr))) & ~7 };
 
-	Sphere spheres[MAX_COUNT];
+	alignas(32) float xs[MAX_COUNT];
+	float ys[MAX_COUNT];
+	float zs[MAX_COUNT];
+	float radii[MAX_COUNT];
 	EntityPtr entities[MAX_COUNT];
 };
 
 static_assert(sizeof(CellPage) == PageAllocator::PAGE_SIZE);
+static_assert(sizeof(CellPage::header) <= 64);
+static_assert(sizeof(CullResult) <= PageAllocator::PAGE_SIZE);
+
+
+#ifdef LUMIX_SIMD_AVX2
+	struct CullingLanes {
+		enum { COUNT = 8 };
+		using Type = float8;
+		static LUMIX_FORCE_INLINE float8 load(const float* src) { return f8Load(src); }
+		static LUMIX_FORCE_INLINE float8 splat(float value) { return f8Splat(value); }
+		static LUMIX_FORCE_INLINE float8 add(float8 a, float8 b) { return f8Add(a, b); }
+		static LUMIX_FORCE_INLINE float8 mul(float8 a, float8 b) { return f8Mul(a, b); }
+		static LUMIX_FORCE_INLINE float8 min(float8 a, float8 b) { return f8Min(a, b); }
+		static LUMIX_FORCE_INLINE u32 moveMask(float8 a) { return (u32)f8MoveMask(a); }
+	};
+#else
+	struct CullingLanes {
+		enum { COUNT = 4 };
+		using Type = float4;
+		static LUMIX_FORCE_INLINE float4 load(const float* src) { return f4Load(src); }
+		static LUMIX_FORCE_INLINE float4 splat(float value) { return f4Splat(value); }
+		static LUMIX_FORCE_INLINE float4 add(float4 a, float4 b) { return f4Add(a, b); }
+		static LUMIX_FORCE_INLINE float4 mul(float4 a, float4 b) { return f4Mul(a, b); }
+		static LUMIX_FORCE_INLINE float4 min(float4 a, float4 b) { return f4Min(a, b); }
+		static LUMIX_FORCE_INLINE u32 moveMask(float4 a) { return (u32)f4MoveMask(a); }
+	};
+#endif
+
+
+static LUMIX_FORCE_INLINE u32 lowestBit(u32 mask) {
+	ASSERT(mask);
+	#ifdef _WIN32
+		unsigned long res;
+		_BitScanForward(&res, mask);
+		return res;
+	#else
+		return __builtin_ctz(mask);
+	#endif
+}
 
 
 struct CullingSystemImpl final : CullingSystem
@@ -79,16 +123,24 @@ struct CullingSystemImpl final : CullingSystem
 		clear();
 	}
 	
-	Sphere* addToCell(CellPage& cell, EntityPtr entity, const DVec3& pos, float radius)
+	static void setSphere(CellPage& cell, int idx, const Vec3& rel_pos, float radius) {
+		cell.xs[idx] = rel_pos.x;
+		cell.ys[idx] = rel_pos.y;
+		cell.zs[idx] = rel_pos.z;
+		cell.radii[idx] = radius;
+	}
+
+	// returns pointer to entity's x coordinate, its cell and index in the cell are derived from that
+	float* addToCell(CellPage& cell, EntityPtr entity, const DVec3& pos, float radius)
 	{
 		const Vec3 rel_pos = Vec3(pos - cell.header.origin);
 		const int count = cell.header.count;
 
-		if(count < CellPage::MAX_COUNT - 1) {
-			cell.spheres[count] = {rel_pos, radius};
+		if(count < CellPage::MAX_COUNT) {
+			setSphere(cell, count, rel_pos, radius);
 			cell.entities[count] = entity;
 			++cell.header.count;
-			return &cell.spheres[count];
+			return &cell.xs[count];
 		}
 
 		void* mem = m_page_allocator.allocate(true);
@@ -104,11 +156,11 @@ struct CullingSystemImpl final : CullingSystem
 		m_cells.push(new_cell);
 		if(!new_cell->header.prev) m_cell_map[new_cell->header.indices] = new_cell;
 
-		new_cell->spheres[0] = {rel_pos, radius};
+		setSphere(*new_cell, 0, rel_pos, radius);
 		new_cell->entities[0] = entity;
 		new_cell->header.count = 1;
 
-		return &new_cell->spheres[0];
+		return &new_cell->xs[0];
 	}
 
 
@@ -135,9 +187,7 @@ struct CullingSystemImpl final : CullingSystem
 		}
 
 		CellPage& cell = *iter.value();
-		Sphere* sphere = addToCell(cell, entity, pos, radius);
-		m_entity_to_cell[entity.index] = sphere;
-		return;
+		m_entity_to_cell[entity.index] = addToCell(cell, entity, pos, radius);
 	}
 
 
@@ -145,10 +195,10 @@ struct CullingSystemImpl final : CullingSystem
 	{
 		if (m_entity_to_cell.size() <= entity.index) return;
 		
-		const Sphere* sphere = m_entity_to_cell[entity.index];
-		if (!sphere) return;
+		const float* x = m_entity_to_cell[entity.index];
+		if (!x) return;
 
-		CellPage& cell = getCell(*sphere);
+		CellPage& cell = getCell(x);
 		if (cell.header.count == 1) {
 			if (!cell.header.prev) {
 				if (!cell.header.next) m_cell_map.erase(cell.header.indices);
@@ -161,20 +211,24 @@ struct CullingSystemImpl final : CullingSystem
 			m_page_allocator.deallocate(&cell, true);
 		}
 		else {
-			const int idx = int(sphere - cell.spheres);
-			EntityPtr last = cell.entities[cell.header.count - 1];
-			cell.entities[idx] = cell.entities[cell.header.count - 1];
-			cell.spheres[idx] = cell.spheres[cell.header.count - 1];
-			m_entity_to_cell[last.index] = &cell.spheres[idx];
+			const int idx = int(x - cell.xs);
+			const int last_idx = cell.header.count - 1;
+			EntityPtr last = cell.entities[last_idx];
+			cell.entities[idx] = last;
+			cell.xs[idx] = cell.xs[last_idx];
+			cell.ys[idx] = cell.ys[last_idx];
+			cell.zs[idx] = cell.zs[last_idx];
+			cell.radii[idx] = cell.radii[last_idx];
+			m_entity_to_cell[last.index] = &cell.xs[idx];
 			--cell.header.count;
 		}
 		m_entity_to_cell[entity.index] = nullptr;
 	}
 
 
-	CellPage& getCell(const Sphere& sphere) const
+	CellPage& getCell(const float* x) const
 	{
-		const intptr_t ptr = (intptr_t)&sphere;
+		const intptr_t ptr = (intptr_t)x;
 		const intptr_t page_ptr = ptr - (ptr % PageAllocator::PAGE_SIZE);
 		return *(CellPage*)page_ptr;
 	}
@@ -182,17 +236,18 @@ struct CullingSystemImpl final : CullingSystem
 
 	void setPosition(EntityRef entity, const DVec3& pos) override
 	{
-		Sphere* sphere = m_entity_to_cell[entity.index];
-		CellPage& cell = getCell(*sphere);
+		float* x = m_entity_to_cell[entity.index];
+		CellPage& cell = getCell(x);
+		const int idx = int(x - cell.xs);
 
 		const IVec3 new_indices(pos * (1 / m_cell_size));
 
 		if(new_indices == cell.header.indices.pos) {
-			sphere->position = Vec3(pos - cell.header.origin);
+			setSphere(cell, idx, Vec3(pos - cell.header.origin), cell.radii[idx]);
 			return;
 		}
 
-		const float radius = sphere->radius;
+		const float radius = cell.radii[idx];
 		const u8 type = cell.header.indices.type;
 		remove(entity);
 		add(entity, type, pos, radius);
@@ -201,20 +256,21 @@ struct CullingSystemImpl final : CullingSystem
 
 	float getRadius(EntityRef entity) override
 	{
-		return m_entity_to_cell[entity.index]->radius;
+		const float* x = m_entity_to_cell[entity.index];
+		const CellPage& cell = getCell(x);
+		return cell.radii[x - cell.xs];
 	}
 
 	void set(EntityRef entity, const DVec3& pos, float radius) override {
-		Sphere* sphere = m_entity_to_cell[entity.index];
-		CellPage& cell = getCell(*sphere);
+		float* x = m_entity_to_cell[entity.index];
+		CellPage& cell = getCell(x);
 		const IVec3 new_indices(pos * (1 / m_cell_size));
 		
 		const bool was_big = cell.header.indices.is_big;
 		const bool is_big = radius > m_cell_size;
 
 		if (was_big == is_big && new_indices == cell.header.indices.pos) {
-			sphere->radius = radius;
-			sphere->position = Vec3(pos - cell.header.origin);
+			setSphere(cell, int(x - cell.xs), Vec3(pos - cell.header.origin), radius);
 			return;
 		}
 
@@ -225,18 +281,19 @@ struct CullingSystemImpl final : CullingSystem
 	
 	void setRadius(EntityRef entity, float radius) override
 	{
-		Sphere* sphere = m_entity_to_cell[entity.index];
-		CellPage& cell = getCell(*sphere);
+		float* x = m_entity_to_cell[entity.index];
+		CellPage& cell = getCell(x);
+		const int idx = int(x - cell.xs);
 		
 		const bool was_big = cell.header.indices.is_big;
 		const bool is_big = radius > m_cell_size;
 
 		if (was_big == is_big) {
-			sphere->radius = radius;
+			cell.radii[idx] = radius;
 			return;
 		}
 		const u8 type = cell.header.indices.type;
-		const DVec3 pos = cell.header.origin + sphere->position;
+		const DVec3 pos = cell.header.origin + Vec3(cell.xs[idx], cell.ys[idx], cell.zs[idx]);
 		remove(entity);
 		add(entity, type, pos, radius);
 	}
@@ -260,69 +317,104 @@ struct CullingSystemImpl final : CullingSystem
 		m_entity_to_cell.clear();
 	}
 
-	LUMIX_FORCE_INLINE void doCulling(const CellPage& cell
+	static CullResult* pushResult(PagedList<CullResult>& list, u8 type, u8 view) {
+		CullResult* result = list.push();
+		result->header.type = type;
+		result->header.view = view;
+		return result;
+	}
+
+	// returns the page the last visible entity was written to
+	LUMIX_FORCE_INLINE CullResult* doCulling(const CellPage& cell
 		, const Frustum& frustum
 		, CullResult* LUMIX_RESTRICT results
 		, PagedList<CullResult>& list
-		, u8 type)
+		, u8 type
+		, u8 view)
 	{
-		const Sphere* LUMIX_RESTRICT start = cell.spheres;
-		const Sphere* LUMIX_RESTRICT end = cell.spheres + cell.header.count;
-		const EntityPtr* LUMIX_RESTRICT sphere_to_entity_map = cell.entities;
-
-		const float4 px = f4Load(frustum.xs);
-		const float4 py = f4Load(frustum.ys);
-		const float4 pz = f4Load(frustum.zs);
-		const float4 pd = f4Load(frustum.ds);
-		const float4 px2 = f4Load(&frustum.xs[4]);
-		const float4 py2 = f4Load(&frustum.ys[4]);
-		const float4 pz2 = f4Load(&frustum.zs[4]);
-		const float4 pd2 = f4Load(&frustum.ds[4]);
-		int cursor = results->header.count;
-
-		int i = 0;
+		using L = CullingLanes;
+		using floatN = L::Type;
+		enum { PLANE_COUNT = (u32)Frustum::Planes::COUNT };
+
+		floatN px[PLANE_COUNT];
+		floatN py[PLANE_COUNT];
+		floatN pz[PLANE_COUNT];
+		floatN pd[PLANE_COUNT];
+		for (u32 p = 0; p < PLANE_COUNT; ++p) {
+			px[p] = L::splat(frustum.xs[p]);
+			py[p] = L::splat(frustum.ys[p]);
+			pz[p] = L::splat(frustum.zs[p]);
+			pd[p] = L::splat(frustum.ds[p]);
+		}
 
-		for (const Sphere *sphere = start; sphere < end; ++sphere, ++i) {
-			const float4 cx = f4Splat(sphere->position.x);
-			const float4 cy = f4Splat(sphere->position.y);
-			const float4 cz = f4Splat(sphere->position.z);
-			const float4 r = f4Splat(-sphere->radius);
+		const EntityPtr* LUMIX_RESTRICT entities = cell.entities;
+		const int count = cell.header.count;
+		int cursor = results->header.count;
 
-			float4 t = cx * px + cy * py + cz * pz + pd;
-			t = t - r;
-			if (f4MoveMask(t)) continue;
+		// L::COUNT spheres at once against all planes, sphere is outside if its signed distance to any plane is < -radius
+		for (int i = 0; i < count; i += L::COUNT) {
+			const floatN x = L::load(cell.xs + i);
+			const floatN y = L::load(cell.ys + i);
+			const floatN z = L::load(cell.zs + i);
+			const floatN r = L::load(cell.radii + i);
+
+			floatN dist = L::add(L::add(L::add(L::mul(x, px[0]), L::mul(y, py[0])), L::add(L::mul(z, pz[0]), pd[0])), r);
+			for (u32 p = 1; p < PLANE_COUNT; ++p) {
+				const floatN t = L::add(L::add(L::add(L::mul(x, px[p]), L::mul(y, py[p])), L::add(L::mul(z, pz[p]), pd[p])), r);
+				dist = L::min(dist, t);
+			}
 
-			t = cx * px2 + cy * py2 + cz * pz2 + pd2;
-			t = t - r;
-			if (f4MoveMask(t)) continue;
+			const u32 valid_mask = count - i >= L::COUNT ? (1 << L::COUNT) - 1 : (1 << (count - i)) - 1;
+			u32 visible = ~L::moveMask(dist) & valid_mask;
+			if (!visible) continue;
 
-			if(cursor == lengthOf(results->entities)) {
+			if (cursor + L::COUNT > (int)lengthOf(results->entities)) {
 				results->header.count = cursor;
-				results = list.push();
-				results->header.type = type;
+				results = pushResult(list, type, view);
 				cursor = 0;
 			}
 
-			results->entities[cursor] = (EntityRef)sphere_to_entity_map[i];
-			++cursor;
+			while (visible) {
+				results->entities[cursor] = (EntityRef)entities[i + lowestBit(visible)];
+				++cursor;
+				visible &= visible - 1;
+			}
 		}
 		results->header.count = cursor;
+		return results;
 	}
 
 	CullResult* cull(const ShiftedFrustum& frustum, u8 type) override
 	{
 		ASSERT(type != 0xff); // 0xff type is reserved for `all types`
-		return cullInternal(frustum, type);
+		CullResult* result;
+		cullInternal(Span(&frustum, 1), type, &result);
+		return result;
 	}
 
 	CullResult* cull(const ShiftedFrustum& frustum) override
 	{
-		return cullInternal(frustum, 0xff);
+		CullResult* result;
+		cullInternal(Span(&frustum, 1), 0xff, &result);
+		return result;
+	}
+
+	void cullMulti(Span<const ShiftedFrustum> frusta, Span<CullResult*> results) override
+	{
+		ASSERT(frusta.length() == results.length());
+		for (u32 i = 0, c = frusta.length(); i < c; i += MAX_VIEWS) {
+			const u32 count = minimum(c - i, (u32)MAX_VIEWS);
+			cullInternal(Span(frusta.begin() + i, count), 0xff, results.begin() + i);
+		}
 	}
 	
-	CullResult* cullInternal(const ShiftedFrustum& frustum, u8 type)
+	// visits each cell once and tests it against all frusta, pages in the shared list are tagged with the view they belong to
+	void cullInternal(Span<const ShiftedFrustum> frusta, u8 type, CullResult** results)
 	{
-		if (m_cells.empty()) return nullptr;
+		const u32 view_count = frusta.length();
+		ASSERT(view_count <= MAX_VIEWS);
+		for (u32 v = 0; v < view_count; ++v) results[v] = nullptr;
+		if (m_cells.empty()) return;
 
 		volatile i32 cell_idx = 0;
 		PagedList<CullResult> list(m_page_allocator);
@@ -331,47 +423,62 @@ struct CullingSystemImpl final : CullingSystem
 			PROFILE_BLOCK("culling");
 			const Vec3 v3_cell_size(m_cell_size);
 			const Vec3 v3_2_cell_size(2 * m_cell_size);
-			CullResult* result = nullptr;
+			CullResult* view_results[MAX_VIEWS] = {};
 			u32 total_count = 0;
 			for(;;) {
 				const i32 idx = atomicIncrement(&cell_idx) - 1;
-				if (idx >= m_cells.size()) return;
+				if (idx >= m_cells.size()) break;
 
 				CellPage& cell = *m_cells[idx];
-				if (type != 0xff && cell.header.indices.type != type) continue;
-				if (!result || result->header.type != cell.header.indices.type) {
-					result = list.push();
-					result->header.type = cell.header.indices.type;
-				}
+				const u8 cell_type = cell.header.indices.type;
+				if (type != 0xff && cell_type != type) continue;
 
 				total_count += cell.header.count;
-				if (cell.header.indices.is_big) {
-					doCulling(cell, frustum.getRelative(cell.header.origin), result, list, cell.header.indices.type);
-				}
-				else if (frustum.containsAABB(cell.header.origin + v3_cell_size, v3_cell_size)) {
-					int to_cpy = cell.header.count;
-					int src_offset = 0;
-					while (to_cpy > 0) {
-						if(result->header.count == lengthOf(result->entities)) {
-							result = list.push();
-							result->header.type = cell.header.indices.type;
+				for (u32 v = 0; v < view_count; ++v) {
+					const ShiftedFrustum& frustum = frusta[v];
+					CullResult*& result = view_results[v];
+					
+					if (cell.header.indices.is_big) {
+						if (!result || result->header.type != cell_type) result = pushResult(list, cell_type, v);
+						result = doCulling(cell, frustum.getRelative(cell.header.origin), result, list, cell_type, v);
+					}
+					else if (frustum.containsAABB(cell.header.origin + v3_cell_size, v3_cell_size)) {
+						if (!result || result->header.type != cell_type) result = pushResult(list, cell_type, v);
+						int to_cpy = cell.header.count;
+						int src_offset = 0;
+						while (to_cpy > 0) {
+							if(result->header.count == lengthOf(result->entities)) {
+								result = pushResult(list, cell_type, v);
+							}
+							const int rem_space = lengthOf(result->entities) - result->header.count;
+							const int step = minimum(to_cpy, rem_space);
+							memcpy(result->entities + result->header.count, cell.entities + src_offset, step * sizeof(cell.entities[0]));
+							src_offset += step;
+							result->header.count += step;
+							to_cpy -= step;
 						}
-						const int rem_space = lengthOf(result->entities) - result->header.count;
-						const int step = minimum(to_cpy, rem_space);
-						memcpy(result->entities + result->header.count, cell.entities + src_offset, step * sizeof(cell.entities[0]));
-						src_offset += step;
-						result->header.count += step;
-						to_cpy -= step;
 					}
-				}
-				else if (frustum.intersectsAABB(cell.header.origin - v3_cell_size, v3_2_cell_size)) {
-					doCulling(cell, frustum.getRelative(cell.header.origin), result, list, cell.header.indices.type);
+					else if (frustum.intersectsAABB(cell.header.origin - v3_cell_size, v3_2_cell_size)) {
+						if (!result || result->header.type != cell_type) result = pushResult(list, cell_type, v);
+						result = doCulling(cell, frustum.getRelative(cell.header.origin), result, list, cell_type, v);
+					}
 				}
 			}
 			profiler::pushInt("count", total_count);
 		});
 
-		return list.detach();
+		// split the shared list into one list per view
+		CullResult* tails[MAX_VIEWS] = {};
+		CullResult* page = list.detach();
+		while (page) {
+			CullResult* next = page->header.next;
+			const u8 view = page->header.view;
+			page->header.next = nullptr;
+			if (tails[view]) tails[view]->header.next = page;
+			else results[view] = page;
+			tails[view] = page;
+			page = next;
+		}
 	}
 	
 
@@ -381,11 +488,13 @@ struct CullingSystemImpl final : CullingSystem
 	}
 
 
+	enum { MAX_VIEWS = 8 };
+
 	IAllocator& m_allocator;
 	PageAllocator& m_page_allocator;
 	HashMap<CellIndices, CellPage*, CellIndicesHasher> m_cell_map;
 	Array<CellPage*> m_cells;
-	Array<Sphere*> m_entity_to_cell;
+	Array<float*> m_entity_to_cell;
 	float m_cell_size;
 };
 
@@ -2,6 +2,7 @@
 
 
 #include "engine/lumix.h"
+#include "engine/page_allocator.h"
 
 
 namespace Lumix
@@ -11,7 +12,6 @@ template <typename T> struct Array;
 template <typename T> struct UniquePtr;
 struct DVec3;
 struct IAllocator;
-struct PageAllocator;
 struct ShiftedFrustum;
 struct Sphere;
 struct Vec3;
@@ -41,8 +41,9 @@ struct CullResult {
 		CullResult* next = nullptr;
 		u32 count = 0;
 		u8 type;
+		u8 view = 0;
 	} header;
-	EntityRef entities[(16384 - sizeof(header)) / sizeof(EntityRef)];
+	EntityRef entities[(PageAllocator::PAGE_SIZE - sizeof(header)) / sizeof(EntityRef)];
 };
 
 struct LUMIX_RENDERER_API CullingSystem
@@ -56,6 +57,8 @@ struct LUMIX_RENDERER_API CullingSystem
 
 	virtual CullResult* cull(const ShiftedFrustum& frustum, u8 type) = 0;
 	virtual CullResult* cull(const ShiftedFrustum& frustum) = 0;
+	// single pass over all cells, results[i] are entities visible in frusta[i]
+	virtual void cullMulti(Span<const ShiftedFrustum> frusta, Span<CullResult*> results) = 0;
 
 	virtual bool isAdded(EntityRef entity) = 0;
 	virtual void add(EntityRef entity, u8 type, const DVec3& pos, float radius) = 0;
@@ -1403,28 +1403,52 @@ static float evalCurve(i64 time, const ofbx::AnimationCurve& curve) {
 	return 0.f;
 };
 
+// max error of compressed curves, in engine units and radians
+// positions are quantized to u16 per curve range, curves with range over 2 * 0xffFF * ANIM_POSITION_ERROR (~13m)
+// can not meet the bound, their error is range / (2 * 0xffFF)
+static constexpr float ANIM_POSITION_ERROR = 0.0001f;
+static constexpr float ANIM_ROTATION_ERROR = 0.0005f;
+// every key skipped in a segment is rechecked when the segment grows, this keeps reduction linear
+static constexpr u32 ANIM_MAX_SKIPPED_KEYS = 256;
+
+// marks keys with `flag` if they can be interpolated from the nearest unmarked keys
+// `is_close(a, b, key, t)` checks whether interpolation between a and b at t is close enough to key
+template <typename F>
+static void reduceKeys(Array<FBXImporter::Key>& keys, u8 flag, F is_close) {
+	u32 from = 0;
+	for (u32 to = 2; to < (u32)keys.size(); ++to) {
+		bool can_skip = to - from <= ANIM_MAX_SKIPPED_KEYS;
+		const double len = double(keys[to].time - keys[from].time);
+		for (u32 i = from + 1; i < to && can_skip; ++i) {
+			const float t = float((keys[i].time - keys[from].time) / len);
+			can_skip = is_close(keys[from], keys[to], keys[i], t);
+		}
+		if (can_skip) keys[to - 1].flags |= flag;
+		else from = to - 1;
+	}
+}
+
 // parent_scale - animated scale is not supported, but we can get rid of static scale if we ignore
 // it in writeSkeleton() and use `parent_scale` in this function
-static void compressPositions(float parent_scale, Array<FBXImporter::Key>& out)
+// error is in the same units as keys
+static void compressPositions(float parent_scale, float error, Array<FBXImporter::Key>& out)
 {
 	if (out.empty()) return;
 
-	const float ERROR = 0; 
-	Vec3 dir = out[1].pos - out[0].pos;
-	dir *= float(1 / ofbx::fbxTimeToSeconds(out[1].time - out[0].time));
-	u32 prev = 0;
-	for (u32 i = 2; i < (u32)out.size(); ++i) {
-		const Vec3 estimate = out[prev].pos + dir * (float)ofbx::fbxTimeToSeconds(out[i].time - out[prev].time);
-		const Vec3 diff = estimate - out[i].pos;
-		if (fabs(diff.x) > ERROR || fabs(diff.y) > ERROR || fabs(diff.z) > ERROR)  {
-			prev = i - 1;
-			dir = out[i].pos - out[i - 1].pos;
-			dir *= float(1 / ofbx::fbxTimeToSeconds(out[i].time - out[i - 1].time));
-		}
-		else {
-			out[i - 1].flags |= 1;
-		}
+	// part of the error is taken by quantization, see ANIM_POSITION_ERROR
+	Vec3 min(FLT_MAX);
+	Vec3 max(-FLT_MAX);
+	for (const FBXImporter::Key& key : out) {
+		min = minimum(min, key.pos);
+		max = maximum(max, key.pos);
 	}
+	const Vec3 quantization_error = (max - min) * (0.5f / 0xffFF);
+	const Vec3 max_diff = maximum(Vec3(error) - quantization_error, Vec3::ZERO);
+
+	reduceKeys(out, 1, [max_diff](const FBXImporter::Key& a, const FBXImporter::Key& b, const FBXImporter::Key& key, float t){
+		const Vec3 diff = lerp(a.pos, b.pos, t) - key.pos;
+		return fabsf(diff.x) <= max_diff.x && fabsf(diff.y) <= max_diff.y && fabsf(diff.z) <= max_diff.z;
+	});
 	for (u32 i = 0; i < (u32)out.size(); ++i) {
 		out[i].pos *= parent_scale;
 	}
@@ -1434,20 +1458,32 @@ static void compressRotations(Array<FBXImporter::Key>& out)
 {
 	if (out.empty()) return;
 
-	const float ERROR = 0; 
-	u32 prev = 0;
-	for (u32 i = 2; i < (u32)out.size(); ++i) {
-		const float t = float(ofbx::fbxTimeToSeconds(out[prev + 1].time - out[prev].time) / ofbx::fbxTimeToSeconds(out[i].time - out[prev].time));
-		const Quat estimate = nlerp(out[prev].rot, out[i].rot, t);
-		if (fabs(estimate.x - out[prev + 1].rot.x) > ERROR || fabs(estimate.y - out[prev + 1].rot.y) > ERROR ||
-			fabs(estimate.z - out[prev + 1].rot.z) > ERROR) 
-		{
-			prev = i - 1;
-		}
-		else {
-			out[i - 1].flags |= 2;
-		}
+	reduceKeys(out, 2, [](const FBXImporter::Key& a, const FBXImporter::Key& b, const FBXImporter::Key& key, float t){
+		const Quat estimate = nlerp(a.rot, b.rot, t);
+		const float sign = estimate.x * key.rot.x + estimate.y * key.rot.y + estimate.z * key.rot.z + estimate.w * key.rot.w < 0 ? -1.f : 1.f;
+		const Vec4 diff(estimate.x - key.rot.x * sign, estimate.y - key.rot.y * sign, estimate.z - key.rot.z * sign, estimate.w - key.rot.w * sign);
+		// chord length is ~half of the angle for small angles
+		return dot(diff, diff) <= ANIM_ROTATION_ERROR * ANIM_ROTATION_ERROR * 0.25f;
+	});
+}
+
+// smallest three, see Animation::RotationCurve
+static void packRotation(const Quat& rot, u16 (&out)[3]) {
+	const float len = sqrtf(rot.x * rot.x + rot.y * rot.y + rot.z * rot.z + rot.w * rot.w);
+	float c[4] = { rot.x / len, rot.y / len, rot.z / len, rot.w / len };
+	u32 largest = 0;
+	for (u32 i = 1; i < 4; ++i) {
+		if (fabsf(c[i]) > fabsf(c[largest])) largest = i;
 	}
+	const float sign = c[largest] < 0 ? -1.f : 1.f;
+	const float SQRT1_2 = 0.70710678f;
+	for (u32 i = 0, j = 0; i < 4; ++i) {
+		if (i == largest) continue;
+		const float v = clamp((c[i] * sign / SQRT1_2 + 1) * 0.5f, 0.f, 1.f);
+		out[j++] = u16(v * 0x7fff + 0.5f);
+	}
+	out[0] |= (largest & 1) << 15;
+	out[1] |= (largest >> 1) << 15;
 }
 
 static float getScaleX(const ofbx::Matrix& mtx)
@@ -1641,7 +1677,7 @@ void FBXImporter::writeAnimations(const char* src, const ImportConfig& cfg)
 				const float parent_scale = parent ? (float)getScaleX(parent->getGlobalTransform()) : 1;
 				// TODO skip curves which do not change anything
 				compressRotations(keys);
-				compressPositions(parent_scale, keys);
+				compressPositions(parent_scale, ANIM_POSITION_ERROR / (parent_scale * cfg.mesh_scale * m_fbx_scale), keys);
 			}
 
 			const u64 stream_translations_count_pos = out_file.size();
@@ -1686,9 +1722,28 @@ void FBXImporter::writeAnimations(const char* src, const ImportConfig& cfg)
 						write(fbx_to_anim_time(key.time));
 					}
 				}
+				Vec3 min(FLT_MAX);
+				Vec3 max(-FLT_MAX);
+				for (Key& key : keys) {
+					if ((key.flags & 1) == 0) {
+						key.pos = fixOrientation(key.pos * cfg.mesh_scale * m_fbx_scale);
+						min = minimum(min, key.pos);
+						max = maximum(max, key.pos);
+					}
+				}
+				const Vec3 range = max - min;
+				const Vec3 to_float = range * (1.f / 0xffFF);
+				write(min);
+				write(to_float);
 				for (Key& key : keys) {
 					if ((key.flags & 1) == 0) {
-						write(fixOrientation(key.pos * cfg.mesh_scale * m_fbx_scale));
+						const Vec3 rel = key.pos - min;
+						const u16 quantized[3] = {
+							range.x > 0 ? u16(rel.x / range.x * 0xffFF + 0.5f) : u16(0),
+							range.y > 0 ? u16(rel.y / range.y * 0xffFF + 0.5f) : u16(0),
+							range.z > 0 ? u16(rel.z / range.z * 0xffFF + 0.5f) : u16(0)
+						};
+						write(quantized);
 					}
 				}
 				++translation_curves_count;
@@ -1729,13 +1784,15 @@ void FBXImporter::writeAnimations(const char* src, const ImportConfig& cfg)
 
 				const BoneNameHash name_hash(bone->name);
 				write(name_hash);
-				if (shouldSample(count, float(anim_len), fps, sizeof(Quat))) {
+				u16 packed[3];
+				if (shouldSample(count, float(anim_len), fps, sizeof(packed))) {
 					write(Animation::CurveType::SAMPLED);
 					count = u32(anim_len * fps + 0.5f);
 					write(count);
 					for (u32 i = 0; i < count; ++i) {
 						const float t = float(anim_len * ((float)i / (count - 1)));
-						write(fixOrientation(sample(*bone, *layer, t + from_frame / fps).rot));
+						packRotation(fixOrientation(sample(*bone, *layer, t + from_frame / fps).rot), packed);
+						write(packed);
 					}
 				}
 				else {
@@ -1748,7 +1805,8 @@ void FBXImporter::writeAnimations(const char* src, const ImportConfig& cfg)
 					}
 					for (Key& key : keys) {
 						if ((key.flags & 2) == 0) {
-							write(fixOrientation(key.rot));
+							packRotation(fixOrientation(key.rot), packed);
+							write(packed);
 						}
 					}
 				}
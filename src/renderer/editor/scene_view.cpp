@@ -881,33 +881,35 @@ void SceneView::renderSelection()
 			const Universe& universe = scene->getUniverse();
 			
 			if (entities.size() > 5000) return;
+			Renderer& renderer = m_pipeline->getRenderer();
+			const SkinningPalettes& palettes = scene->getSkinningPalettes();
 			for (EntityRef e : entities) {
 				if (!scene->getUniverse().hasComponent(e, MODEL_INSTANCE_TYPE)) continue;
 
 				const Model* model = scene->getModelInstanceModel(e);
 				if (!model || !model->isReady()) continue;
 
-				const Pose* pose = scene->lockPose(e);
+				// skinned meshes use palettes computed by the pipeline this frame
+				u32 bones_offset = SkinningPalettes::INVALID_OFFSET;
+				if (palettes.frame == renderer.frameNumber() && e.index < palettes.offsets.size()) {
+					bones_offset = palettes.offsets[e.index];
+				}
 				for (int i = 0; i <= model->getLODIndices()[0].to; ++i) {
 					const Mesh& mesh = model->getMesh(i);
 					
-					Item& item = m_items.emplace(m_allocator);
+					Item& item = m_items.emplace();
 					item.material = mesh.material->getRenderData();
 					u32 define_mask = item.material->define_mask;
 					item.mesh = mesh.render_data;
 					item.mtx = universe.getRelativeMatrix(e, m_cam_pos);
-					if (pose && pose->count > 0 && mesh.type == Mesh::SKINNED) {
+					item.bones_buffer = gpu::INVALID_BUFFER;
+					if (bones_offset != SkinningPalettes::INVALID_OFFSET && mesh.type == Mesh::SKINNED) {
 						define_mask |= skinned_define;
-						item.pose.reserve(pose->count);
-						for (int j = 0, c = pose->count; j < c; ++j) {
-							const Model::Bone& bone = model->getBone(j);
-							const LocalRigidTransform tmp = {pose->positions[j], pose->rotations[j]};
-							item.pose.push((tmp * bone.inv_bind_transform).toDualQuat());
-						}
+						item.bones_buffer = palettes.buffer;
 					}
 					item.program = mesh.material->getShader()->getProgram(mesh.vertex_decl, define_mask);
-					if (item.pose.empty()) {
-						item.ub = m_pipeline->getRenderer().allocUniform(sizeof(item.mtx));
+					if (!item.bones_buffer) {
+						item.ub = renderer.allocUniform(sizeof(item.mtx));
 						memcpy(item.ub.ptr, &item.mtx, sizeof(item.mtx));
 					}
 					else {
@@ -915,21 +917,19 @@ void SceneView::renderSelection()
 							float layer;
 							float fur_scale;
 							float gravity;
-							float padding;
+							u32 bones_offset;
 							Matrix model_mtx;
-							// DualQuat bones[];
 						};
 
-						item.ub = m_pipeline->getRenderer().allocUniform(sizeof(UBPrefix) + item.pose.byte_size());
+						item.ub = renderer.allocUniform(sizeof(UBPrefix));
 						UBPrefix* dc = (UBPrefix*)item.ub.ptr;
 						dc->layer = 0;
 						dc->fur_scale = 0;
 						dc->gravity = 0;
+						dc->bones_offset = bones_offset;
 						dc->model_mtx = item.mtx;
-						memcpy(item.ub.ptr + sizeof(UBPrefix), item.pose.begin(), item.pose.byte_size());
 					}
 				}
-				scene->unlockPose(e, false);
 			}
 		}
 
@@ -941,6 +941,7 @@ void SceneView::renderSelection()
 				const Mesh::RenderData* rd = item.mesh;
 			
 				gpu::bindUniformBuffer(UniformBuffer::DRAWCALL, item.ub.buffer, item.ub.offset, item.ub.size);
+				if (item.bones_buffer) gpu::bindShaderBuffer(item.bones_buffer, 10, gpu::BindShaderBufferFlags::NONE);
 				gpu::bindTextures(item.material->textures, 0, item.material->textures_count);
 				gpu::useProgram(item.program);
 				gpu::bindIndexBuffer(rd->index_buffer_handle);
@@ -953,8 +954,7 @@ void SceneView::renderSelection()
 		}
 
 		struct Item {
-			Item(IAllocator& allocator) : pose(allocator) {}
-			Array<DualQuat> pose;
+			gpu::BufferHandle bones_buffer;
 			gpu::ProgramHandle program;
 			Mesh::RenderData* mesh;
 			Material::RenderData* material;
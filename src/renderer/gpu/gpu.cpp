@@ -1446,6 +1446,7 @@ void memoryBarrier(gpu::MemoryBarrierType type, BufferHandle) {
 	GLbitfield gl = 0;
 	if (u32(type & gpu::MemoryBarrierType::SSBO)) gl |= GL_SHADER_STORAGE_BARRIER_BIT;
 	if (u32(type & gpu::MemoryBarrierType::COMMAND)) gl |= GL_COMMAND_BARRIER_BIT;
+	if (u32(type & gpu::MemoryBarrierType::VERTEX_ATTRIB)) gl |= GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT;
 	glMemoryBarrier(gl);
 }
 
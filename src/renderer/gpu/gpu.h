@@ -53,7 +53,8 @@ enum class QueryType : u32 {
 
 enum class MemoryBarrierType : u32 {
 	SSBO = 1 << 0,
-	COMMAND = 1 << 1
+	COMMAND = 1 << 1,
+	VERTEX_ATTRIB = 1 << 2
 };
 
 enum class PrimitiveType : u32 {
@@ -0,0 +1,658 @@
+#include "gpu.h"
+#include "gpu_null.h"
+#include "engine/allocator.h"
+#include "engine/crt.h"
+#include "engine/hash.h"
+#include "engine/math.h"
+#include "engine/os.h"
+#include "engine/stream.h"
+#include "engine/string.h"
+#include "engine/sync.h"
+
+namespace Lumix {
+
+namespace gpu {
+
+// keep order, this is serialized
+enum class Command : u8 {
+	CLEAR,
+	SCISSOR,
+	VIEWPORT,
+	SET_STATE,
+	CREATE_PROGRAM,
+	USE_PROGRAM,
+	DISPATCH,
+	CREATE_BUFFER,
+	CREATE_TEXTURE,
+	CREATE_TEXTURE_VIEW,
+	GENERATE_MIPMAPS,
+	UPDATE_TEXTURE,
+	BIND_VERTEX_BUFFER,
+	BIND_IMAGE_TEXTURE,
+	BIND_TEXTURES,
+	BIND_SHADER_BUFFER,
+	UPDATE_BUFFER,
+	UNMAP,
+	BIND_UNIFORM_BUFFER,
+	COPY_TEXTURE,
+	COPY_BUFFER,
+	READ_TEXTURE,
+	QUERY_TIMESTAMP,
+	BEGIN_QUERY,
+	END_QUERY,
+	DESTROY_PROGRAM,
+	DESTROY_BUFFER,
+	DESTROY_TEXTURE,
+	BIND_INDEX_BUFFER,
+	BIND_INDIRECT_BUFFER,
+	DRAW_INDIRECT,
+	DRAW_INDEXED_INSTANCED,
+	DRAW_INDEXED,
+	DRAW_ARRAYS,
+	DRAW_ARRAYS_INSTANCED,
+	PUSH_DEBUG_GROUP,
+	POP_DEBUG_GROUP,
+	SET_FRAMEBUFFER_CUBE,
+	SET_FRAMEBUFFER,
+	MEMORY_BARRIER,
+
+	COUNT
+};
+
+static const char* COMMAND_NAMES[] = {
+	"clear",
+	"scissor",
+	"viewport",
+	"setState",
+	"createProgram",
+	"useProgram",
+	"dispatch",
+	"createBuffer",
+	"createTexture",
+	"createTextureView",
+	"generateMipmaps",
+	"updateTexture",
+	"bindVertexBuffer",
+	"bindImageTexture",
+	"bindTextures",
+	"bindShaderBuffer",
+	"updateBuffer",
+	"unmap",
+	"bindUniformBuffer",
+	"copyTexture",
+	"copyBuffer",
+	"readTexture",
+	"queryTimestamp",
+	"beginQuery",
+	"endQuery",
+	"destroyProgram",
+	"destroyBuffer",
+	"destroyTexture",
+	"bindIndexBuffer",
+	"bindIndirectBuffer",
+	"drawIndirect",
+	"drawIndexedInstanced",
+	"drawIndexed",
+	"drawArrays",
+	"drawArraysInstanced",
+	"pushDebugGroup",
+	"popDebugGroup",
+	"setFramebufferCube",
+	"setFramebuffer",
+	"memoryBarrier",
+};
+static_assert(lengthOf(COMMAND_NAMES) == (u32)Command::COUNT);
+
+// each command is a header followed by `args_count` u32 arguments and `string_size` bytes of zero terminated string
+#pragma pack(1)
+struct CommandHeader {
+	Command cmd;
+	u8 args_count;
+	u16 string_size;
+};
+#pragma pack()
+
+struct Buffer {
+	u32 id;
+	BufferFlags flags;
+	u64 size;
+	// backing memory for map(), allocated on first use
+	u8* data = nullptr;
+};
+
+struct Texture {
+	u32 id;
+	u32 width;
+	u32 height;
+	u32 depth;
+	TextureFormat format;
+	TextureFlags flags;
+};
+
+struct Program {
+	u32 id;
+};
+
+struct Query {
+	u64 result = 0;
+};
+
+struct NullGPU {
+	NullGPU(IAllocator& allocator)
+		: allocator(allocator)
+		, stream(allocator)
+		, last_stream(allocator)
+	{}
+
+	IAllocator& allocator;
+	os::ThreadID thread;
+	u32 frame = 0;
+	u32 last_buffer_id = 0;
+	u32 last_texture_id = 0;
+	u32 last_program_id = 0;
+	OutputMemoryStream stream;
+	RecordStats stats;
+	Mutex mutex;
+	// guarded by mutex
+	OutputMemoryStream last_stream;
+	RecordStats last_stats;
+};
+
+Local<NullGPU> null_gpu;
+
+static u32 toArg(u32 v) { return v; }
+static u32 toArg(i32 v) { return (u32)v; }
+static u32 toArg(float v) { u32 res; memcpy(&res, &v, sizeof(res)); return res; }
+static u32 toArg(size_t v) { ASSERT(v <= 0xffFFffFF); return (u32)v; }
+static u32 toArg(BufferHandle v) { return v ? v->id : 0; }
+static u32 toArg(TextureHandle v) { return v ? v->id : 0; }
+static u32 toArg(ProgramHandle v) { return v ? v->id : 0; }
+template <typename T> static u32 toArg(T v) { return (u32)v; }
+
+// stats are computed from the encoded command, so recording and replay always agree
+static void accumulate(const CommandHeader& header, const u32* args, RecordStats& stats) {
+	++stats.commands;
+	stats.bytes_recorded += sizeof(header) + header.args_count * sizeof(u32) + header.string_size;
+	switch (header.cmd) {
+		case Command::DRAW_INDIRECT:
+		case Command::DRAW_INDEXED_INSTANCED:
+		case Command::DRAW_INDEXED:
+		case Command::DRAW_ARRAYS:
+		case Command::DRAW_ARRAYS_INSTANCED:
+			++stats.draw_calls;
+			break;
+		case Command::DISPATCH: ++stats.dispatches; break;
+		case Command::USE_PROGRAM: ++stats.program_changes; break;
+		case Command::SET_FRAMEBUFFER:
+		case Command::SET_FRAMEBUFFER_CUBE:
+			++stats.framebuffer_changes;
+			break;
+		// args: buffer, flags, size, has_data
+		case Command::CREATE_BUFFER: if (args[3]) stats.bytes_uploaded += args[2]; break;
+		// args: buffer, size
+		case Command::UPDATE_BUFFER:
+		case Command::UNMAP:
+			stats.bytes_uploaded += args[1];
+			break;
+		// args: texture, mip, x, y, z, w, h, format, size
+		case Command::UPDATE_TEXTURE: stats.bytes_uploaded += args[8]; break;
+		default: break;
+	}
+}
+
+static void recordRaw(Command cmd, const u32* args, u32 args_count, const char* str) {
+	ASSERT(args_count <= 0xff);
+	CommandHeader header;
+	header.cmd = cmd;
+	header.args_count = (u8)args_count;
+	header.string_size = str ? u16(minimum(stringLength(str), 0xfffe) + 1) : 0;
+	OutputMemoryStream& stream = null_gpu->stream;
+	stream.write(header);
+	stream.write(args, args_count * sizeof(u32));
+	if (str) {
+		stream.write(str, header.string_size - 1);
+		stream.write((char)0);
+	}
+	accumulate(header, args, null_gpu->stats);
+}
+
+template <typename... Args>
+static void record(Command cmd, Args... args) {
+	const u32 tmp[] = { toArg(args)..., 0 };
+	recordRaw(cmd, tmp, sizeof...(args), nullptr);
+}
+
+template <typename... Args>
+static void recordString(Command cmd, const char* str, Args... args) {
+	const u32 tmp[] = { toArg(args)..., 0 };
+	recordRaw(cmd, tmp, sizeof...(args), str);
+}
+
+void checkThread() {
+	ASSERT(null_gpu->thread == os::getCurrentThreadID());
+}
+
+void launchRenderDoc() {}
+void startCapture() {}
+void stopCapture() {}
+void setCurrentWindow(void* window_handle) {}
+bool getMemoryStats(MemoryStats& stats) { return false; }
+bool isOriginBottomLeft() { return true; }
+
+void preinit(IAllocator& allocator, bool load_renderdoc) {
+	null_gpu.create(allocator);
+}
+
+bool init(void* window_handle, InitFlags flags) {
+	null_gpu->thread = os::getCurrentThreadID();
+	return true;
+}
+
+void shutdown() {
+	checkThread();
+	null_gpu.destroy();
+}
+
+u32 swapBuffers() {
+	checkThread();
+	NullGPU& ctx = *null_gpu;
+	{
+		MutexGuard guard(ctx.mutex);
+		// swap so both streams keep their capacity
+		OutputMemoryStream tmp(static_cast<OutputMemoryStream&&>(ctx.last_stream));
+		ctx.last_stream = static_cast<OutputMemoryStream&&>(ctx.stream);
+		ctx.stream = static_cast<OutputMemoryStream&&>(tmp);
+		ctx.last_stats = ctx.stats;
+	}
+	ctx.stream.clear();
+	ctx.stats = {};
+	return ctx.frame++;
+}
+
+bool frameFinished(u32 frame) { return true; }
+void waitFrame(u32 frame) {}
+
+void getRecordedFrame(OutputMemoryStream& stream, RecordStats& stats) {
+	MutexGuard guard(null_gpu->mutex);
+	stream.clear();
+	stream.write(null_gpu->last_stream.data(), null_gpu->last_stream.size());
+	stats = null_gpu->last_stats;
+}
+
+bool replay(Span<const u8> stream, RecordStats& stats, IOutputStream* dump) {
+	InputMemoryStream blob(stream.begin(), stream.length());
+	u32 depth = 0;
+	while (blob.getPosition() < blob.size()) {
+		CommandHeader header;
+		if (!blob.read(&header, sizeof(header))) return false;
+		if ((u32)header.cmd >= (u32)Command::COUNT) return false;
+		if (blob.getPosition() + header.args_count * sizeof(u32) + header.string_size > blob.size()) return false;
+		const u32* args = (const u32*)blob.skip(header.args_count * sizeof(u32));
+		const char* str = header.string_size ? (const char*)blob.skip(header.string_size) : nullptr;
+		// args are not aligned in the stream
+		u32 args_copy[256];
+		memcpy(args_copy, args, header.args_count * sizeof(u32));
+		accumulate(header, args_copy, stats);
+
+		if (!dump) continue;
+		if (header.cmd == Command::POP_DEBUG_GROUP && depth > 0) --depth;
+		for (u32 i = 0; i < depth; ++i) *dump << "  ";
+		*dump << COMMAND_NAMES[(u32)header.cmd];
+		for (u32 i = 0; i < header.args_count; ++i) {
+			*dump << (i == 0 ? " " : ", ") << args_copy[i];
+		}
+		if (str) *dump << " \"" << str << "\"";
+		*dump << "\n";
+		if (header.cmd == Command::PUSH_DEBUG_GROUP) ++depth;
+	}
+	return true;
+}
+
+u32 getSize(TextureFormat format, u32 w, u32 h) {
+	switch (format) {
+		case TextureFormat::BC1:
+		case TextureFormat::BC4:
+			return ((w + 3) / 4) * ((h + 3) / 4) * 8;
+		case TextureFormat::BC2:
+		case TextureFormat::BC3:
+		case TextureFormat::BC5:
+			return ((w + 3) / 4) * ((h + 3) / 4) * 16;
+		case TextureFormat::R8: return w * h;
+		case TextureFormat::RG8:
+		case TextureFormat::R16:
+		case TextureFormat::R16F:
+			return w * h * 2;
+		case TextureFormat::SRGB: return w * h * 3;
+		case TextureFormat::RGBA16:
+		case TextureFormat::RGBA16F:
+		case TextureFormat::RG32F:
+			return w * h * 8;
+		case TextureFormat::RGBA32F: return w * h * 16;
+		default: return w * h * 4;
+	}
+}
+
+int getSize(AttributeType type) {
+	switch(type) {
+		case AttributeType::FLOAT: return 4;
+		case AttributeType::I8: return 1;
+		case AttributeType::U8: return 1;
+		case AttributeType::I16: return 2;
+		default: ASSERT(false); return 0;
+	}
+}
+
+u32 VertexDecl::getStride() const {
+	u32 stride = 0;
+	for (u32 i = 0; i < attributes_count; ++i) {
+		stride += attributes[i].components_count * getSize(attributes[i].type);
+	}
+	return stride;
+}
+
+void VertexDecl::computeHash() {
+	hash = RuntimeHash32(attributes, sizeof(Attribute) * attributes_count);
+}
+
+void VertexDecl::addAttribute(u8 idx, u8 byte_offset, u8 components_num, AttributeType type, u8 flags) {
+	if(attributes_count >= lengthOf(attributes)) {
+		ASSERT(false);
+		return;
+	}
+
+	Attribute& attr = attributes[attributes_count];
+	attr.components_count = components_num;
+	attr.idx = idx;
+	attr.flags = flags;
+	attr.type = type;
+	attr.byte_offset = byte_offset;
+	++attributes_count;
+	hash = RuntimeHash32(attributes, sizeof(Attribute) * attributes_count);
+}
+
+TextureHandle allocTextureHandle() {
+	Texture* t = LUMIX_NEW(null_gpu->allocator, Texture);
+	t->id = ++null_gpu->last_texture_id;
+	return t;
+}
+
+BufferHandle allocBufferHandle() {
+	Buffer* b = LUMIX_NEW(null_gpu->allocator, Buffer);
+	b->id = ++null_gpu->last_buffer_id;
+	return b;
+}
+
+ProgramHandle allocProgramHandle() {
+	Program* p = LUMIX_NEW(null_gpu->allocator, Program);
+	p->id = ++null_gpu->last_program_id;
+	return p;
+}
+
+void clear(ClearFlags flags, const float* color, float depth) {
+	checkThread();
+	if (u32(flags & ClearFlags::COLOR)) {
+		record(Command::CLEAR, flags, depth, color[0], color[1], color[2], color[3]);
+	}
+	else {
+		record(Command::CLEAR, flags, depth);
+	}
+}
+
+void scissor(u32 x, u32 y, u32 w, u32 h) {
+	checkThread();
+	record(Command::SCISSOR, x, y, w, h);
+}
+
+void viewport(u32 x, u32 y, u32 w, u32 h) {
+	checkThread();
+	record(Command::VIEWPORT, x, y, w, h);
+}
+
+void setState(StateFlags state) {
+	checkThread();
+	record(Command::SET_STATE, u32((u64)state & 0xffFFffFF), u32((u64)state >> 32));
+}
+
+bool createProgram(ProgramHandle program, const VertexDecl& decl, const char** srcs, const ShaderType* types, u32 num, const char** prefixes, u32 prefixes_count, const char* name) {
+	checkThread();
+	ASSERT(program);
+	recordString(Command::CREATE_PROGRAM, name, program, decl.hash.getHashValue(), num);
+	return true;
+}
+
+void useProgram(ProgramHandle program) {
+	checkThread();
+	record(Command::USE_PROGRAM, program);
+}
+
+void dispatch(u32 num_groups_x, u32 num_groups_y, u32 num_groups_z) {
+	checkThread();
+	record(Command::DISPATCH, num_groups_x, num_groups_y, num_groups_z);
+}
+
+void memoryBarrier(MemoryBarrierType type, BufferHandle buffer) {
+	checkThread();
+	record(Command::MEMORY_BARRIER, type, buffer);
+}
+
+void createBuffer(BufferHandle buffer, BufferFlags flags, size_t size, const void* data) {
+	checkThread();
+	ASSERT(buffer);
+	buffer->flags = flags;
+	buffer->size = size;
+	record(Command::CREATE_BUFFER, buffer, flags, size, data ? 1 : 0);
+}
+
+bool createTexture(TextureHandle handle, u32 w, u32 h, u32 depth, TextureFormat format, TextureFlags flags, const char* debug_name) {
+	checkThread();
+	ASSERT(handle);
+	handle->width = w;
+	handle->height = h;
+	handle->depth = depth;
+	handle->format = format;
+	handle->flags = flags;
+	recordString(Command::CREATE_TEXTURE, debug_name, handle, w, h, depth, format, flags);
+	return true;
+}
+
+void createTextureView(TextureHandle view, TextureHandle texture) {
+	checkThread();
+	ASSERT(view);
+	ASSERT(texture);
+	view->width = texture->width;
+	view->height = texture->height;
+	view->depth = 1;
+	view->format = texture->format;
+	view->flags = texture->flags;
+	record(Command::CREATE_TEXTURE_VIEW, view, texture);
+}
+
+void generateMipmaps(TextureHandle texture) {
+	checkThread();
+	record(Command::GENERATE_MIPMAPS, texture);
+}
+
+void update(TextureHandle texture, u32 mip, u32 x, u32 y, u32 z, u32 w, u32 h, TextureFormat format, const void* buf, u32 size) {
+	checkThread();
+	record(Command::UPDATE_TEXTURE, texture, mip, x, y, z, w, h, format, size);
+}
+
+QueryHandle createQuery(QueryType type) {
+	return LUMIX_NEW(null_gpu->allocator, Query);
+}
+
+void bindVertexBuffer(u32 binding_idx, BufferHandle buffer, u32 buffer_offset, u32 stride) {
+	checkThread();
+	record(Command::BIND_VERTEX_BUFFER, binding_idx, buffer, buffer_offset, stride);
+}
+
+void bindImageTexture(TextureHandle texture, u32 unit) {
+	checkThread();
+	record(Command::BIND_IMAGE_TEXTURE, texture, unit);
+}
+
+void bindTextures(const TextureHandle* handles, u32 offset, u32 count) {
+	checkThread();
+	u32 args[33];
+	count = minimum(count, lengthOf(args) - 1);
+	args[0] = offset;
+	for (u32 i = 0; i < count; ++i) args[i + 1] = handles ? toArg(handles[i]) : 0;
+	recordRaw(Command::BIND_TEXTURES, args, count + 1, nullptr);
+}
+
+void bindShaderBuffer(BufferHandle buffer, u32 binding_point, BindShaderBufferFlags flags) {
+	checkThread();
+	record(Command::BIND_SHADER_BUFFER, buffer, binding_point, flags);
+}
+
+void update(BufferHandle buffer, const void* data, size_t size) {
+	checkThread();
+	ASSERT(buffer);
+	ASSERT(u32(buffer->flags & BufferFlags::IMMUTABLE) == 0);
+	record(Command::UPDATE_BUFFER, buffer, size);
+}
+
+void* map(BufferHandle buffer, size_t size) {
+	checkThread();
+	ASSERT(buffer);
+	ASSERT(u32(buffer->flags & BufferFlags::IMMUTABLE) == 0);
+	ASSERT(size <= buffer->size);
+	if (!buffer->data) buffer->data = (u8*)null_gpu->allocator.allocate_aligned(buffer->size, 16);
+	return buffer->data;
+}
+
+void unmap(BufferHandle buffer) {
+	checkThread();
+	ASSERT(buffer);
+	// we do not know how much was written, assume the whole buffer like the GL backend's invalidating map
+	record(Command::UNMAP, buffer, buffer->size);
+}
+
+void bindUniformBuffer(u32 ub_index, BufferHandle buffer, size_t offset, size_t size) {
+	checkThread();
+	record(Command::BIND_UNIFORM_BUFFER, ub_index, buffer, offset, size);
+}
+
+void copy(TextureHandle dst, TextureHandle src, u32 dst_x, u32 dst_y) {
+	checkThread();
+	record(Command::COPY_TEXTURE, dst, src, dst_x, dst_y);
+}
+
+void copy(BufferHandle dst, BufferHandle src, u32 dst_offset, u32 src_offset, u32 size) {
+	checkThread();
+	record(Command::COPY_BUFFER, dst, src, dst_offset, src_offset, size);
+}
+
+void readTexture(TextureHandle texture, u32 mip, Span<u8> buf) {
+	checkThread();
+	memset(buf.begin(), 0, buf.length());
+	record(Command::READ_TEXTURE, texture, mip, buf.length());
+}
+
+void queryTimestamp(QueryHandle query) {
+	checkThread();
+	query->result = os::Timer::getRawTimestamp();
+	record(Command::QUERY_TIMESTAMP);
+}
+
+void beginQuery(QueryHandle query) {
+	checkThread();
+	query->result = 0;
+	record(Command::BEGIN_QUERY);
+}
+
+void endQuery(QueryHandle query) {
+	checkThread();
+	record(Command::END_QUERY);
+}
+
+u64 getQueryResult(QueryHandle query) { return query->result; }
+u64 getQueryFrequency() { return os::Timer::getFrequency(); }
+bool isQueryReady(QueryHandle query) { return true; }
+
+void destroy(ProgramHandle program) {
+	checkThread();
+	record(Command::DESTROY_PROGRAM, program);
+	LUMIX_DELETE(null_gpu->allocator, program);
+}
+
+void destroy(BufferHandle buffer) {
+	checkThread();
+	record(Command::DESTROY_BUFFER, buffer);
+	if (buffer->data) null_gpu->allocator.deallocate_aligned(buffer->data);
+	LUMIX_DELETE(null_gpu->allocator, buffer);
+}
+
+void destroy(TextureHandle texture) {
+	checkThread();
+	record(Command::DESTROY_TEXTURE, texture);
+	LUMIX_DELETE(null_gpu->allocator, texture);
+}
+
+void destroy(QueryHandle query) {
+	LUMIX_DELETE(null_gpu->allocator, query);
+}
+
+void bindIndexBuffer(BufferHandle buffer) {
+	checkThread();
+	record(Command::BIND_INDEX_BUFFER, buffer);
+}
+
+void bindIndirectBuffer(BufferHandle buffer) {
+	checkThread();
+	record(Command::BIND_INDIRECT_BUFFER, buffer);
+}
+
+void drawIndirect(DataType index_type, u32 indirect_buffer_offset) {
+	checkThread();
+	record(Command::DRAW_INDIRECT, index_type, indirect_buffer_offset);
+}
+
+void drawIndexedInstanced(PrimitiveType primitive_type, u32 indices_count, u32 instances_count, DataType index_type) {
+	checkThread();
+	record(Command::DRAW_INDEXED_INSTANCED, primitive_type, indices_count, instances_count, index_type);
+}
+
+void drawIndexed(PrimitiveType primitive_type, u32 byte_offset, u32 count, DataType index_type) {
+	checkThread();
+	record(Command::DRAW_INDEXED, primitive_type, byte_offset, count, index_type);
+}
+
+void drawArrays(PrimitiveType type, u32 offset, u32 count) {
+	checkThread();
+	record(Command::DRAW_ARRAYS, type, offset, count);
+}
+
+void drawArraysInstanced(PrimitiveType type, u32 indices_count, u32 instances_count) {
+	checkThread();
+	record(Command::DRAW_ARRAYS_INSTANCED, type, indices_count, instances_count);
+}
+
+void pushDebugGroup(const char* msg) {
+	checkThread();
+	recordString(Command::PUSH_DEBUG_GROUP, msg);
+}
+
+void popDebugGroup() {
+	checkThread();
+	record(Command::POP_DEBUG_GROUP);
+}
+
+void setFramebufferCube(TextureHandle cube, u32 face, u32 mip) {
+	checkThread();
+	record(Command::SET_FRAMEBUFFER_CUBE, cube, face, mip);
+}
+
+void setFramebuffer(TextureHandle* attachments, u32 num, TextureHandle depth_stencil, FramebufferFlags flags) {
+	checkThread();
+	u32 args[18];
+	num = minimum(num, lengthOf(args) - 2);
+	args[0] = (u32)flags;
+	args[1] = toArg(depth_stencil);
+	for (u32 i = 0; i < num; ++i) args[i + 2] = toArg(attachments[i]);
+	recordRaw(Command::SET_FRAMEBUFFER, args, num + 2, nullptr);
+}
+
+} // namespace gpu
+
+} // namespace Lumix
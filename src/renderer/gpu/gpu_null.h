@@ -0,0 +1,33 @@
+#pragma once
+
+#include "gpu.h"
+
+
+namespace Lumix {
+
+struct IOutputStream;
+struct OutputMemoryStream;
+
+namespace gpu {
+
+// null backend, built instead of gpu.cpp with --with-null-gpu
+// nothing is rendered, every gpu:: call is recorded into a compact command stream instead
+
+struct RecordStats {
+	u32 commands = 0;
+	u32 draw_calls = 0;
+	u32 dispatches = 0;
+	u32 program_changes = 0;
+	u32 framebuffer_changes = 0;
+	u64 bytes_uploaded = 0;
+	u64 bytes_recorded = 0;
+};
+
+// command stream and stats of the last finished frame, can be called from any thread
+LUMIX_RENDERER_API void getRecordedFrame(OutputMemoryStream& stream, RecordStats& stats);
+// decodes recorded stream, writes one line per command to `dump` if it's not null
+LUMIX_RENDERER_API bool replay(Span<const u8> stream, RecordStats& stats, IOutputStream* dump);
+
+} // namespace gpu
+
+} // namespace Lumix
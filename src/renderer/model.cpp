@@ -1,6 +1,7 @@
 #include "engine/lumix.h"
 
 #include "engine/array.h"
+#include "engine/atomic.h"
 #include "engine/crt.h"
 #include "engine/file_system.h"
 #include "engine/hash.h"
@@ -111,6 +112,7 @@ Model::Model(const Path& path, ResourceManager& resource_manager, Renderer& rend
 	, m_bone_map(m_allocator)
 	, m_meshes(m_allocator)
 	, m_bones(m_allocator)
+	, m_bone_batches(m_allocator)
 	, m_first_nonroot_bone_index(0)
 	, m_renderer(renderer)
 {
@@ -371,6 +373,9 @@ bool Model::parseBones(InputMemoryStream& file)
 		return false;
 	}
 
+	static volatile i32 last_bone_map_id = 0;
+	m_bone_map_id = atomicIncrement(&last_bone_map_id);
+
 	m_bones.reserve(bone_count);
 	for (int i = 0; i < bone_count; ++i) {
 		Model::Bone& b = m_bones.emplace(m_allocator);
@@ -425,6 +430,31 @@ bool Model::parseBones(InputMemoryStream& file)
 			m_bones[i].relative_transform = m_bones[i].transform;
 		}
 	}
+
+	u8 depths[Bone::MAX_COUNT];
+	u8 max_depth = 0;
+	for (int i = 0; i < bone_count; ++i) {
+		const int p = m_bones[i].parent_idx;
+		depths[i] = p < 0 ? 0 : u8(depths[p] + 1);
+		max_depth = maximum(max_depth, depths[i]);
+	}
+	for (u8 depth = 1; depth <= max_depth; ++depth) {
+		u32 lane = 0;
+		for (int i = 0; i < bone_count; ++i) {
+			if (depths[i] != depth) continue;
+			if (lane == 0) m_bone_batches.emplace();
+			BoneBatch& batch = m_bone_batches.back();
+			batch.bones[lane] = u8(i);
+			batch.parents[lane] = u8(m_bones[i].parent_idx);
+			lane = (lane + 1) % 4;
+		}
+		if (lane == 0) continue;
+		BoneBatch& batch = m_bone_batches.back();
+		for (; lane < 4; ++lane) {
+			batch.bones[lane] = batch.bones[lane - 1];
+			batch.parents[lane] = batch.parents[lane - 1];
+		}
+	}
 	return true;
 }
 
@@ -621,6 +651,9 @@ void Model::unload()
 	}
 	m_meshes.clear();
 	m_bones.clear();
+	m_bone_batches.clear();
+	if (m_bone_map_id) m_prev_bone_map_id = m_bone_map_id;
+	m_bone_map_id = 0;
 }
 
 
@@ -158,6 +158,14 @@ public:
 		int parent_idx;
 	};
 
+	// 4 non-root bones at the same depth in hierarchy, transformed together by Pose
+	// last batch of each depth repeats its last bone to fill all 4 lanes
+	struct BoneBatch {
+		u8 bones[4];
+		u8 parents[4];
+	};
+	static_assert(Bone::MAX_COUNT <= 0xff);
+
 	static const ResourceType TYPE;
 
 public:
@@ -182,7 +190,13 @@ public:
 	i32 getBoneParent(u32 idx) { return m_bones[idx].parent_idx; }
 	const Bone& getBone(u32 i) const { return m_bones[i]; }
 	int getFirstNonrootBoneIndex() const { return m_first_nonroot_bone_index; }
+	// ordered by depth, parents are always in earlier batches
+	Span<const BoneBatch> getBoneBatches() const { return m_bone_batches; }
 	BoneMap::ConstIterator getBoneIndex(BoneNameHash hash) const { return m_bone_map.find(hash); }
+	// unique across all models, changes on every load, 0 if there are no bones loaded
+	u32 getBoneMapID() const { return m_bone_map_id; }
+	// id of the previously loaded bone map, 0 if there was none
+	u32 getPrevBoneMapID() const { return m_prev_bone_map_id; }
 	void getPose(Pose& pose);
 	void getRelativePose(Pose& pose);
 	float getOriginBoundingRadius() const { return m_origin_bounding_radius; }
@@ -216,11 +230,14 @@ private:
 	Renderer& m_renderer;
 	Array<Mesh> m_meshes;
 	Array<Bone> m_bones;
+	Array<BoneBatch> m_bone_batches;
 	LODMeshIndices m_lod_indices[MAX_LOD_COUNT + 1];
 	float m_lod_distances[MAX_LOD_COUNT];
 	float m_origin_bounding_radius = 0;
 	float m_center_bounding_radius = 0;
 	BoneMap m_bone_map;
+	u32 m_bone_map_id = 0;
+	u32 m_prev_bone_map_id = 0;
 	AABB m_aabb;
 	int m_first_nonroot_bone_index;
 };
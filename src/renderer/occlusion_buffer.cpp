@@ -0,0 +1,236 @@
+#include "occlusion_buffer.h"
+#include "engine/atomic.h"
+#include "engine/crt.h"
+#include "engine/geometry.h"
+#include "engine/job_system.h"
+#include "engine/profiler.h"
+#include "engine/simd.h"
+
+
+namespace Lumix {
+
+
+// vertices closer than this are considered to be behind the camera
+static constexpr float MIN_W = 0.01f;
+static constexpr u32 TILES_X = OcclusionBuffer::WIDTH / OcclusionBuffer::TILE_SIZE;
+
+static_assert(OcclusionBuffer::WIDTH % OcclusionBuffer::TILE_SIZE == 0);
+static_assert(OcclusionBuffer::HEIGHT % OcclusionBuffer::TILE_SIZE == 0);
+static_assert(OcclusionBuffer::TILE_SIZE % 4 == 0);
+
+
+struct ClipPos {
+	float x, y, w;
+};
+
+// z is not needed, Vec4 math is not inlined and this is hot
+static LUMIX_FORCE_INLINE ClipPos toClip(const Matrix& m, float x, float y, float z) {
+	const Vec4* c = m.columns;
+	return {
+		c[0].x * x + c[1].x * y + c[2].x * z + c[3].x,
+		c[0].y * x + c[1].y * y + c[2].y * z + c[3].y,
+		c[0].w * x + c[1].w * y + c[2].w * z + c[3].w
+	};
+}
+
+
+OcclusionBuffer::OcclusionBuffer(IAllocator& allocator)
+	: m_allocator(allocator)
+	, m_triangles(allocator)
+	, m_screen_vertices(allocator)
+{
+	m_depth = (float*)allocator.allocate_aligned(WIDTH * HEIGHT * sizeof(float), 16);
+	clear();
+}
+
+OcclusionBuffer::~OcclusionBuffer() {
+	m_allocator.deallocate_aligned(m_depth);
+}
+
+void OcclusionBuffer::clear() {
+	m_triangles.clear();
+	memset(m_depth, 0, WIDTH * HEIGHT * sizeof(float));
+	memset(m_hiz, 0, sizeof(m_hiz));
+}
+
+void OcclusionBuffer::addOccluder(const Matrix& mvp, Span<const Vec3> vertices, const void* indices, u32 indices_count, bool indices16) {
+	// x, y in pixels, z = 1 / w, negative z for vertices behind near plane
+	m_screen_vertices.resize(vertices.length());
+	for (u32 i = 0, c = vertices.length(); i < c; ++i) {
+		const Vec3& v = vertices[i];
+		const ClipPos p = toClip(mvp, v.x, v.y, v.z);
+		if (p.w < MIN_W) {
+			m_screen_vertices[i].z = -1;
+			continue;
+		}
+		const float rcp_w = 1 / p.w;
+		m_screen_vertices[i].x = (p.x * rcp_w * 0.5f + 0.5f) * WIDTH;
+		m_screen_vertices[i].y = (p.y * rcp_w * 0.5f + 0.5f) * HEIGHT;
+		m_screen_vertices[i].z = rcp_w;
+	}
+
+	const u16* indices16_ptr = (const u16*)indices;
+	const u32* indices32_ptr = (const u32*)indices;
+	for (u32 i = 0; i + 2 < indices_count; i += 3) {
+		Vec3 v[3];
+		bool behind = false;
+		for (u32 j = 0; j < 3; ++j) {
+			const u32 idx = indices16 ? indices16_ptr[i + j] : indices32_ptr[i + j];
+			v[j] = m_screen_vertices[idx];
+			behind = behind || v[j].z < 0;
+		}
+		if (behind) continue;
+
+		float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+		if (fabsf(area) < 1e-4f) continue;
+		if (area < 0) {
+			swap(v[1], v[2]);
+			area = -area;
+		}
+
+		const float min_x = maximum(minimum(v[0].x, v[1].x, v[2].x), 0.f);
+		const float min_y = maximum(minimum(v[0].y, v[1].y, v[2].y), 0.f);
+		const float max_x = minimum(maximum(v[0].x, v[1].x, v[2].x), float(WIDTH - 1));
+		const float max_y = minimum(maximum(v[0].y, v[1].y, v[2].y), float(HEIGHT - 1));
+		if (min_x > max_x || min_y > max_y) continue;
+
+		Triangle& t = m_triangles.emplace();
+		t.min_x = (i32)min_x;
+		t.min_y = (i32)min_y;
+		t.max_x = (i32)max_x;
+		t.max_y = (i32)max_y;
+
+		// edge i goes from v[i] to v[i + 1], it's >= 0 inside the triangle; evaluated at pixel centers
+		for (u32 j = 0; j < 3; ++j) {
+			const Vec3& a = v[j];
+			const Vec3& b = v[(j + 1) % 3];
+			t.edge_a[j] = a.y - b.y;
+			t.edge_b[j] = b.x - a.x;
+			t.edge_c[j] = -(t.edge_a[j] * a.x + t.edge_b[j] * a.y) + 0.5f * (t.edge_a[j] + t.edge_b[j]);
+		}
+
+		// barycentric weight of a vertex is the opposite edge function / area
+		const float rcp_area = 1 / area;
+		t.depth_a = (t.edge_a[1] * v[0].z + t.edge_a[2] * v[1].z + t.edge_a[0] * v[2].z) * rcp_area;
+		t.depth_b = (t.edge_b[1] * v[0].z + t.edge_b[2] * v[1].z + t.edge_b[0] * v[2].z) * rcp_area;
+		t.depth_c = (t.edge_c[1] * v[0].z + t.edge_c[2] * v[1].z + t.edge_c[0] * v[2].z) * rcp_area;
+	}
+}
+
+void OcclusionBuffer::rasterizeBand(u32 band) {
+	const i32 band_min_y = band * TILE_SIZE;
+	const i32 band_max_y = band_min_y + TILE_SIZE - 1;
+	alignas(16) static const float lane_offsets[4] = { 0, 1, 2, 3 };
+	const float4 offsets = f4Load(lane_offsets);
+
+	for (const Triangle& t : m_triangles) {
+		if (t.max_y < band_min_y || t.min_y > band_max_y) continue;
+
+		const i32 from_x = t.min_x & ~3;
+		const i32 from_y = maximum(t.min_y, band_min_y);
+		const i32 to_y = minimum(t.max_y, band_max_y);
+		const float4 xs = f4Add(f4Splat((float)from_x), offsets);
+
+		const float4 e0_step = f4Splat(t.edge_a[0] * 4);
+		const float4 e1_step = f4Splat(t.edge_a[1] * 4);
+		const float4 e2_step = f4Splat(t.edge_a[2] * 4);
+		const float4 z_step = f4Splat(t.depth_a * 4);
+
+		for (i32 y = from_y; y <= to_y; ++y) {
+			const float fy = (float)y;
+			float4 e0 = f4Add(f4Mul(f4Splat(t.edge_a[0]), xs), f4Splat(t.edge_b[0] * fy + t.edge_c[0]));
+			float4 e1 = f4Add(f4Mul(f4Splat(t.edge_a[1]), xs), f4Splat(t.edge_b[1] * fy + t.edge_c[1]));
+			float4 e2 = f4Add(f4Mul(f4Splat(t.edge_a[2]), xs), f4Splat(t.edge_b[2] * fy + t.edge_c[2]));
+			float4 z = f4Add(f4Mul(f4Splat(t.depth_a), xs), f4Splat(t.depth_b * fy + t.depth_c));
+			float* LUMIX_RESTRICT row = m_depth + y * WIDTH;
+
+			for (i32 x = from_x; x <= t.max_x; x += 4) {
+				const u32 inside = ~f4MoveMask(f4Min(e0, f4Min(e1, e2))) & 0xf;
+				if (inside == 0xf) {
+					f4Store(row + x, f4Max(f4Load(row + x), z));
+				}
+				else if (inside) {
+					alignas(16) float tmp[4];
+					f4Store(tmp, z);
+					for (u32 i = 0; i < 4; ++i) {
+						if (inside & (1 << i)) row[x + i] = maximum(row[x + i], tmp[i]);
+					}
+				}
+				e0 = f4Add(e0, e0_step);
+				e1 = f4Add(e1, e1_step);
+				e2 = f4Add(e2, e2_step);
+				z = f4Add(z, z_step);
+			}
+		}
+	}
+
+	for (u32 tile = 0; tile < TILES_X; ++tile) {
+		float4 tile_min = f4Load(m_depth + band_min_y * WIDTH + tile * TILE_SIZE);
+		for (i32 y = band_min_y; y <= band_max_y; ++y) {
+			const float* row = m_depth + y * WIDTH + tile * TILE_SIZE;
+			for (u32 x = 0; x < TILE_SIZE; x += 4) {
+				tile_min = f4Min(tile_min, f4Load(row + x));
+			}
+		}
+		alignas(16) float tmp[4];
+		f4Store(tmp, tile_min);
+		m_hiz[band * TILES_X + tile] = minimum(tmp[0], tmp[1], tmp[2], tmp[3]);
+	}
+}
+
+void OcclusionBuffer::rasterize() {
+	PROFILE_FUNCTION();
+	profiler::pushInt("triangles", m_triangles.size());
+	jobs::forEach(HEIGHT / TILE_SIZE, 1, [&](i32 from, i32 to){
+		PROFILE_BLOCK("rasterize occluders");
+		for (i32 band = from; band < to; ++band) rasterizeBand(band);
+	});
+}
+
+bool OcclusionBuffer::isOccluded(const Matrix& mvp, const AABB& aabb) const {
+	float min_x = FLT_MAX;
+	float min_y = FLT_MAX;
+	float max_x = -FLT_MAX;
+	float max_y = -FLT_MAX;
+	float max_depth = 0;
+	for (u32 i = 0; i < 8; ++i) {
+		const ClipPos c = toClip(mvp, i & 1 ? aabb.max.x : aabb.min.x, i & 2 ? aabb.max.y : aabb.min.y, i & 4 ? aabb.max.z : aabb.min.z);
+		if (c.w < MIN_W) return false;
+		const float rcp_w = 1 / c.w;
+		const float x = (c.x * rcp_w * 0.5f + 0.5f) * WIDTH;
+		const float y = (c.y * rcp_w * 0.5f + 0.5f) * HEIGHT;
+		min_x = minimum(min_x, x);
+		min_y = minimum(min_y, y);
+		max_x = maximum(max_x, x);
+		max_y = maximum(max_y, y);
+		max_depth = maximum(max_depth, rcp_w);
+	}
+	if (max_x < 0 || max_y < 0 || min_x >= WIDTH || min_y >= HEIGHT) return false;
+
+	const i32 x0 = (i32)maximum(min_x, 0.f);
+	const i32 y0 = (i32)maximum(min_y, 0.f);
+	const i32 x1 = (i32)minimum(max_x, float(WIDTH - 1));
+	const i32 y1 = (i32)minimum(max_y, float(HEIGHT - 1));
+
+	for (i32 ty = y0 / TILE_SIZE; ty <= y1 / TILE_SIZE; ++ty) {
+		for (i32 tx = x0 / TILE_SIZE; tx <= x1 / TILE_SIZE; ++tx) {
+			// even the farthest occluder in the tile is in front of the box
+			if (m_hiz[ty * TILES_X + tx] > max_depth) continue;
+
+			const i32 from_x = maximum(x0, tx * TILE_SIZE);
+			const i32 to_x = minimum(x1, tx * TILE_SIZE + TILE_SIZE - 1);
+			const i32 from_y = maximum(y0, ty * TILE_SIZE);
+			const i32 to_y = minimum(y1, ty * TILE_SIZE + TILE_SIZE - 1);
+			for (i32 y = from_y; y <= to_y; ++y) {
+				const float* row = m_depth + y * WIDTH;
+				for (i32 x = from_x; x <= to_x; ++x) {
+					if (row[x] <= max_depth) return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+
+} // namespace Lumix
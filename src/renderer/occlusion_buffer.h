@@ -0,0 +1,58 @@
+#pragma once
+
+#include "engine/array.h"
+#include "engine/math.h"
+
+
+namespace Lumix
+{
+
+struct AABB;
+
+// small CPU depth buffer with occluders, used to skip meshes hidden behind other meshes
+// depth is stored as 1 / w, i.e. bigger is closer, 0 means there is no occluder
+// all matrices are model-view-projection matrices, relative to camera
+struct LUMIX_RENDERER_API OcclusionBuffer {
+	enum {
+		WIDTH = 256,
+		HEIGHT = 128,
+		TILE_SIZE = 8
+	};
+
+	OcclusionBuffer(IAllocator& allocator);
+	~OcclusionBuffer();
+
+	void clear();
+	// not thread safe; triangles crossing the near plane are skipped
+	void addOccluder(const Matrix& mvp, Span<const Vec3> vertices, const void* indices, u32 indices_count, bool indices16);
+	// rasterizes added occluders on workers and builds hierarchical Z
+	void rasterize();
+	// conservative, true only if the whole box is behind occluders; thread safe after rasterize
+	bool isOccluded(const Matrix& mvp, const AABB& aabb) const;
+	bool hasOccluders() const { return !m_triangles.empty(); }
+	const float* getDepth() const { return m_depth; }
+
+private:
+	// edge functions and depth plane in screen space, a * x + b * y + c
+	struct Triangle {
+		float edge_a[3];
+		float edge_b[3];
+		float edge_c[3];
+		float depth_a;
+		float depth_b;
+		float depth_c;
+		i32 min_x, min_y;
+		i32 max_x, max_y;
+	};
+
+	void rasterizeBand(u32 band);
+
+	IAllocator& m_allocator;
+	Array<Triangle> m_triangles;
+	Array<Vec3> m_screen_vertices;
+	float* m_depth;
+	// min depth of each tile
+	float m_hiz[(WIDTH / TILE_SIZE) * (HEIGHT / TILE_SIZE)];
+};
+
+} //namespace Lumix
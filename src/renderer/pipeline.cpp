@@ -17,6 +17,7 @@
 #include "engine/path.h"
 #include "engine/profiler.h"
 #include "engine/resource_manager.h"
+#include "engine/simd.h"
 #include "engine/stack_array.h"
 #include "engine/universe.h"
 #include "culling_system.h"
@@ -24,6 +25,7 @@
 #include "font.h"
 #include "material.h"
 #include "model.h"
+#include "occlusion_buffer.h"
 #include "particle_system.h"
 #include "pipeline.h"
 #include "pose.h"
@@ -45,7 +47,11 @@ namespace Lumix
 // instancer 31 - 16; if instanced
 // instance group 15 - 0; if instanced
 
-static constexpr u32 INSTANCED_MESHES_BUFFER_SIZE = 64 * 1024 * 1024; // TODO dynamic
+static constexpr u32 INSTANCED_MESHES_BUFFER_INIT_SIZE = 1024 * 1024;
+// counters before culled instances in the instanced meshes buffer
+static constexpr u32 INSTANCED_MESHES_HEADER_SIZE = 48;
+static constexpr u32 INSTANCED_MESH_DATA_SIZE = 2 * sizeof(Vec4);
+static constexpr u32 INSTANCE_GATHER_BUFFER_SIZE = 16 * 1024 * 1024;
 static constexpr u32 SORT_VALUE_TYPE_MASK = (1 << 5) - 1;
 static constexpr u64 SORT_KEY_BUCKET_SHIFT = 56;
 static constexpr u64 SORT_KEY_INSTANCED_FLAG = (u64)1 << 55;
@@ -184,11 +190,9 @@ namespace LuaWrapper {
 		return {rs};
 	}
 
-	template <>
-	CameraParams toType(lua_State* L, int idx)
+	// camera params created by scripts
+	static void toTypeFull(lua_State* L, int idx, CameraParams& cp)
 	{
-		CameraParams cp;
-
 		lua_getfield(L, idx, "view");
 		if (!lua_istable(L, -1)) {
 			lua_pop(L, 1);
@@ -251,7 +255,23 @@ namespace LuaWrapper {
 		
 		lua_pop(L, 1);
 		cp.frustum.setPlanesFromPoints();
-		
+	}
+
+	template <>
+	CameraParams toType(lua_State* L, int idx)
+	{
+		CameraParams cp;
+
+		if (LuaWrapper::getField(L, idx, "native") == LUA_TUSERDATA) {
+			memcpy(&cp, lua_touserdata(L, -1), sizeof(cp));
+			lua_pop(L, 1);
+		}
+		else {
+			lua_pop(L, 1);
+			toTypeFull(L, idx, cp);
+		}
+
+		// scalars can be changed by scripts
 		if(!LuaWrapper::checkField(L, idx, "lod_multiplier", &cp.lod_multiplier)) {
 			luaL_error(L, "Missing lod_multiplier in camera params");
 		}
@@ -335,10 +355,7 @@ namespace LuaWrapper {
 		}
 	}
 
-	void push(lua_State* L, const CameraParams& params)
-	{
-		lua_createtable(L, 0, 4);
-
+	static void pushFrustum(lua_State* L, const ShiftedFrustum& frustum) {
 		lua_createtable(L, 32+24, 0);
 		auto push_floats = [L](const float* values, int count, int offset){
 			for(int i = 0; i < count; ++i) {
@@ -347,33 +364,66 @@ namespace LuaWrapper {
 			}
 		};
 
-		push_floats(params.frustum.xs, (int)Frustum::Planes::COUNT, 0);
-		push_floats(params.frustum.ys, (int)Frustum::Planes::COUNT, (int)Frustum::Planes::COUNT);
-		push_floats(params.frustum.zs, (int)Frustum::Planes::COUNT, (int)Frustum::Planes::COUNT * 2);
-		push_floats(params.frustum.ds, (int)Frustum::Planes::COUNT, (int)Frustum::Planes::COUNT * 3);
-		push_floats(&params.frustum.points[0].x, 24, (int)Frustum::Planes::COUNT * 4);
+		push_floats(frustum.xs, (int)Frustum::Planes::COUNT, 0);
+		push_floats(frustum.ys, (int)Frustum::Planes::COUNT, (int)Frustum::Planes::COUNT);
+		push_floats(frustum.zs, (int)Frustum::Planes::COUNT, (int)Frustum::Planes::COUNT * 2);
+		push_floats(frustum.ds, (int)Frustum::Planes::COUNT, (int)Frustum::Planes::COUNT * 3);
+		push_floats(&frustum.points[0].x, 24, (int)Frustum::Planes::COUNT * 4);
 
-		LuaWrapper::push(L, params.frustum.origin);
+		LuaWrapper::push(L, frustum.origin);
 		lua_setfield(L, -2, "origin");
-		lua_setfield(L, -2, "frustum");
-
-		LuaWrapper::setField(L, -1, "is_shadow", params.is_shadow);
-		LuaWrapper::setField(L, -1, "position", params.pos);
-		LuaWrapper::setField(L, -1, "lod_multiplier", params.lod_multiplier);
+	}
 
+	static void pushMatrix(lua_State* L, const Matrix& m) {
 		lua_createtable(L, 16, 0);
 		for (int i = 0; i < 16; ++i) {
-			LuaWrapper::push(L, params.view[i]);
+			LuaWrapper::push(L, m[i]);
 			lua_rawseti(L, -2, i + 1);
 		}
-		lua_setfield(L, -2, "view");
+	}
 
-		lua_createtable(L, 16, 0);
-		for (int i = 0; i < 16; ++i) {
-			LuaWrapper::push(L, params.projection[i]);
-			lua_rawseti(L, -2, i + 1);
+	// __index of camera params, frustum and matrices are pushed only when a script reads them
+	static int cameraParamsIndex(lua_State* L) {
+		const char* key = lua_tostring(L, 2);
+		lua_pushstring(L, "native");
+		lua_rawget(L, 1);
+		const void* native = lua_touserdata(L, -1);
+		lua_pop(L, 1);
+		if (!native || !key) return 0;
+
+		CameraParams cp;
+		memcpy(&cp, native, sizeof(cp));
+		if (equalStrings(key, "frustum")) pushFrustum(L, cp.frustum);
+		else if (equalStrings(key, "view")) pushMatrix(L, cp.view);
+		else if (equalStrings(key, "projection")) pushMatrix(L, cp.projection);
+		else return 0;
+
+		lua_pushvalue(L, 2);
+		lua_pushvalue(L, -2);
+		lua_rawset(L, 1);
+		return 1;
+	}
+
+	// camera params are passed back to pipeline functions several times per view,
+	// so they stay native in userdata and only scalar fields are in the table
+	void push(lua_State* L, const CameraParams& params)
+	{
+		lua_createtable(L, 0, 4);
+
+		// userdata is not aligned enough for CameraParams
+		void* native = lua_newuserdata(L, sizeof(params));
+		memcpy(native, &params, sizeof(params));
+		lua_setfield(L, -2, "native");
+
+		LuaWrapper::setField(L, -1, "is_shadow", params.is_shadow);
+		LuaWrapper::setField(L, -1, "position", params.pos);
+		LuaWrapper::setField(L, -1, "lod_multiplier", params.lod_multiplier);
+
+		if (luaL_newmetatable(L, "lumix_camera_params")) {
+			lua_pushcfunction(L, cameraParamsIndex);
+			lua_setfield(L, -2, "__index");
 		}
-		lua_setfield(L, -2, "projection");
+		lua_setmetatable(L, -2);
 	}
 
 }
@@ -671,6 +721,22 @@ struct PipelineImpl final : Pipeline
 		Array<u64> values;
 	};
 
+	struct InstanceStoreUB {
+		Vec4 camera_hi;
+		Vec4 camera_lo;
+		u32 input_offset;
+		u32 output_offset;
+		u32 count;
+		u32 padding;
+	};
+
+	// entity indices of auto-instanced meshes, their transforms are gathered from ModelInstanceStore on GPU
+	struct InstanceGather {
+		Renderer::TransientSlice input;
+		Renderer::TransientSlice ub;
+		u32 count = 0;
+	};
+
 	struct AutoInstancer {
 		struct alignas(4096) Page {
 			struct Header {
@@ -703,6 +769,7 @@ struct PipelineImpl final : Pipeline
 			, last_page(rhs.last_page)
 			, first_page(rhs.first_page)
 			, page_allocator(rhs.page_allocator)
+			, gather(rhs.gather)
 		{
 			ASSERT(rhs.first_page == rhs.last_page);
 			rhs.last_page = rhs.first_page = nullptr;
@@ -773,6 +840,7 @@ struct PipelineImpl final : Pipeline
 		Page* last_page = nullptr;
 		Page* first_page = nullptr;
 		PageAllocator& page_allocator;
+		InstanceGather gather;
 	};
 	
 	struct InstancedMeshes {
@@ -837,6 +905,27 @@ struct PipelineImpl final : Pipeline
 		jobs::Signal ready;
 	};
 
+	// LOD of model instances from previous frames, shared by all views since they select LOD from the same point
+	// entry is recomputed if the instance changed or the camera travelled far enough to cross a LOD boundary
+	// entry = expiration in camera travel (float bits) | (version << 3 | lod) << 32
+	// views create sort keys in parallel, entries are accessed only with relaxed atomics
+	struct LODCache {
+		LODCache(IAllocator& allocator) : entries(allocator) {}
+
+		Array<u64> entries;
+		DVec3 ref_point = DVec3(0);
+		float travel = 0;
+		float multiplier = 0;
+	};
+
+	// views passed to a single `cull` call, culled in one pass over the culling system
+	struct CullBatch {
+		CullBatch(IAllocator& allocator) : views(allocator) {}
+
+		Array<View*> views;
+		jobs::Signal culled;
+	};
+
 	// converts float to u32 so it can be used in radix sort
 	// float float_value = 0;
 	// u32 sort_key = floatFlip(*(u32*)&float_value);
@@ -863,12 +952,16 @@ struct PipelineImpl final : Pipeline
 		, m_textures(allocator)
 		, m_buffers(allocator)
 		, m_views(allocator)
+		, m_cull_batches(allocator)
+		, m_occlusion_buffer(allocator)
+		, m_lod_cache(allocator)
 	{
 		m_viewport.w = m_viewport.h = 800;
 		ResourceManagerHub& rm = renderer.getEngine().getResourceManager();
 		m_draw2d_shader = rm.load<Shader>(Path("pipelines/draw2d.shd"));
 		m_debug_shape_shader = rm.load<Shader>(Path("pipelines/debug_shape.shd"));
 		m_instancing_shader = rm.load<Shader>(Path("pipelines/instancing.shd"));
+		m_instance_store_shader = rm.load<Shader>(Path("pipelines/instance_store.shd"));
 		
 		m_draw2d.clear({1, 1});
 
@@ -905,9 +998,12 @@ struct PipelineImpl final : Pipeline
 
 		m_resource->onLoaded<&PipelineImpl::onStateChanged>(this);
 
-		const Renderer::MemRef im_mem = { INSTANCED_MESHES_BUFFER_SIZE, nullptr, false };
+		const Renderer::MemRef im_mem = { INSTANCED_MESHES_BUFFER_INIT_SIZE, nullptr, false };
 		m_instanced_meshes_buffer = m_renderer.createBuffer(im_mem, gpu::BufferFlags::COMPUTE_WRITE | gpu::BufferFlags::SHADER_BUFFER);
 
+		const Renderer::MemRef ig_mem = { INSTANCE_GATHER_BUFFER_SIZE, nullptr, false };
+		m_instance_gather_buffer = m_renderer.createBuffer(ig_mem, gpu::BufferFlags::COMPUTE_WRITE | gpu::BufferFlags::SHADER_BUFFER);
+
 		const Renderer::MemRef ind_mem = { 64 * 1024, nullptr, false }; // TODO size
 		m_indirect_buffer = m_renderer.createBuffer(ind_mem, gpu::BufferFlags::COMPUTE_WRITE | gpu::BufferFlags::SHADER_BUFFER);
 
@@ -957,6 +1053,7 @@ struct PipelineImpl final : Pipeline
 		m_draw2d_shader->decRefCount();
 		m_debug_shape_shader->decRefCount();
 		m_instancing_shader->decRefCount();
+		m_instance_store_shader->decRefCount();
 
 		for (const Renderbuffer& rb : m_renderbuffers) {
 			m_renderer.destroy(rb.handle);
@@ -970,6 +1067,7 @@ struct PipelineImpl final : Pipeline
 		m_renderer.destroy(m_cube_ib);
 		m_renderer.destroy(m_cube_vb);
 		m_renderer.destroy(m_instanced_meshes_buffer);
+		m_renderer.destroy(m_instance_gather_buffer);
 		m_renderer.destroy(m_indirect_buffer);
 		m_renderer.destroy(m_shadow_atlas.texture);
 		m_renderer.destroy(m_cluster_buffers.clusters.buffer);
@@ -1417,6 +1515,7 @@ struct PipelineImpl final : Pipeline
 		global_state.cam_world_pos = Vec4(Vec3(m_viewport.pos), 1);
 		m_prev_viewport = m_viewport;
 		m_indirect_buffer_offset = 0;
+		m_instance_gather_offset = 0;
 
 		if(m_scene) {
 			const EntityPtr global_light = m_scene->getActiveEnvironment();
@@ -1442,7 +1541,17 @@ struct PipelineImpl final : Pipeline
 				gpu::bindUniformBuffer(UniformBuffer::PASS, gpu::INVALID_BUFFER, 0, 0);
 				gpu::bindUniformBuffer(UniformBuffer::DRAWCALL, gpu::INVALID_BUFFER, 0, 0);
 				gpu::bindUniformBuffer(UniformBuffer::SHADOW, gpu::INVALID_BUFFER, 0, 0);
-				int tmp[12] = {};
+				const u32 required = INSTANCED_MESHES_HEADER_SIZE + instanced_meshes_required;
+				GPUBufferSizer& sizer = pipeline->m_instanced_meshes_sizer;
+				if (sizer.update(required)) {
+					gpu::destroy(pipeline->m_instanced_meshes_buffer);
+					pipeline->m_instanced_meshes_buffer = gpu::allocBufferHandle();
+					gpu::createBuffer(pipeline->m_instanced_meshes_buffer, gpu::BufferFlags::COMPUTE_WRITE | gpu::BufferFlags::SHADER_BUFFER, sizer.size, nullptr);
+				}
+				profiler::pushInt("Instanced meshes (kB)", required / 1024);
+				profiler::pushInt("Instanced meshes buffer (kB)", sizer.size / 1024);
+
+				int tmp[INSTANCED_MESHES_HEADER_SIZE / sizeof(int)] = {};
 				gpu::update(pipeline->m_instanced_meshes_buffer, &tmp, sizeof(tmp));
 			}
 			void setup() override {
@@ -1454,14 +1563,27 @@ struct PipelineImpl final : Pipeline
 			PipelineImpl* pipeline;
 			GlobalState global_state;
 			PassState pass_state;
+			volatile i32 instanced_meshes_required = 0;
 		};
 
 		StartPipelineJob& start_job = m_renderer.createJob<StartPipelineJob>();
 		start_job.pipeline = this;
 		start_job.global_state = global_state;
+		m_instanced_meshes_required = &start_job.instanced_meshes_required;
 		m_renderer.queue(start_job, 0);
+
+		m_instance_gather_program = gpu::INVALID_PROGRAM;
+		if (m_scene && m_instance_store_shader->isReady()) {
+			m_instance_gather_program = m_instance_store_shader->getProgram(0);
+			flushModelInstanceStore();
+		}
+		if (m_scene) {
+			updateSkinningPalettes();
+			updateLODCache();
+		}
 		
 		m_views.clear();
+		m_cull_batches.clear();
 		
 		LuaWrapper::DebugGuard lua_debug_guard(m_lua_state);
 		lua_rawgeti(m_lua_state, LUA_REGISTRYINDEX, m_lua_env);
@@ -1506,8 +1628,10 @@ struct PipelineImpl final : Pipeline
 		end_job.instanced_meshes = m_views.empty() ? nullptr : m_views[0]->instanced_meshes;
 		m_renderer.queue(end_job, 0);
 		m_renderer.waitForCommandSetup();
+		m_instanced_meshes_required = nullptr;
 
 		m_views.clear();
+		m_cull_batches.clear();
 
 		return true;
 	}
@@ -1750,6 +1874,7 @@ struct PipelineImpl final : Pipeline
 		RenderScene* scene = universe ? (RenderScene*)universe->getScene("renderer") : nullptr;
 		if (m_scene == scene) return;
 		m_scene = scene;
+		m_lod_cache.entries.clear();
 		if (m_lua_state && m_scene) callInitScene();
 	}
 	
@@ -2585,7 +2710,8 @@ struct PipelineImpl final : Pipeline
 	// TODO optimize
 	struct FillClustersJob : Renderer::RenderJob {
 		FillClustersJob(LinearAllocator& current_frame_allocator, IAllocator& allocator)
-			: m_clusters(current_frame_allocator)
+			: m_frame_allocator(current_frame_allocator)
+			, m_clusters(current_frame_allocator)
 			, m_map(current_frame_allocator)
 			, m_point_lights(allocator)
 			, m_env_probes(current_frame_allocator)
@@ -2708,96 +2834,90 @@ struct PipelineImpl final : Pipeline
 				return m3 > n3 ? 1 : 0;
 			});
 
-			auto range = [](const Vec3& p, float r, i32 size, const Vec4* planes){
-				IVec2 range = { -1, -1 };
-				if (planeDist(planes[0], p) < -r) return range;
-					
-				for (i32 i = 0; i < size; ++i) {
-					const float d = planeDist(planes[i + 1], p);
-					if (d > r) continue;
-
-					range.x = i;
-						
-					for (i32 i2 = i + 1; i2 < size + 1; ++i2) {
-						const float d = planeDist(planes[i2], p);
-						if (d < -r) {
-							range.y = i2;
-							return range;
-						}
-					}
-					range.y = size;
-					return range;
-				}
-				return range;
-			};
+			ClusterPlanes cluster_xplanes, cluster_yplanes, cluster_zplanes;
+			cluster_xplanes.init(xplanes, size.x);
+			cluster_yplanes.init(yplanes, size.y);
+			cluster_zplanes.init(zplanes, size.z);
 
 			// TODO tighter fit
-			auto for_each_light_pair = [&](auto f){
-				for (i32 i = 0, c = point_lights.size(); i < c; ++i) {
-					ClusterPointLight& light = point_lights[i];
-					const float r = light.radius;
-					const Vec3 p = light.pos;
-
-					const IVec2 xrange = range(p, r, size.x, xplanes);
-					const IVec2 yrange = range(p, r, size.y, yplanes);
-					const IVec2 zrange = range(p, r, size.z, zplanes);
-
-					for (i32 z = zrange.x; z < zrange.y; ++z) {
-						for (i32 y = yrange.x; y < yrange.y; ++y) {
-							for (i32 x = xrange.x; x < xrange.y; ++x) {
-								const u32 idx = x + y * size.x + z * size.x * size.y;
-								Cluster& cluster = clusters[idx];
-								f(cluster, i);
-							}
+			auto for_each_pair = [&](i32 idx, const Vec3& p, float r, auto f){
+				const IVec2 xrange = range(cluster_xplanes, p, r);
+				const IVec2 yrange = range(cluster_yplanes, p, r);
+				const IVec2 zrange = range(cluster_zplanes, p, r);
+
+				for (i32 z = zrange.x; z < zrange.y; ++z) {
+					for (i32 y = yrange.x; y < yrange.y; ++y) {
+						for (i32 x = xrange.x; x < xrange.y; ++x) {
+							const u32 cluster_idx = x + y * size.x + z * size.x * size.y;
+							f(clusters[cluster_idx], idx);
 						}
 					}
 				}
 			};
-			
+
 			auto for_each_env_probe_pair = [&](auto f){
 				for (i32 i = 0, c = env_probes.size(); i < c; ++i) {
-					const Vec3 p = env_probes[i].pos;
-					const float r = length(env_probes[i].outer_range);
-				
-					const IVec2 xrange = range(p, r, size.x, xplanes);
-					const IVec2 yrange = range(p, r, size.y, yplanes);
-					const IVec2 zrange = range(p, r, size.z, zplanes);
-
-					for (i32 z = zrange.x; z < zrange.y; ++z) {
-						for (i32 y = yrange.x; y < yrange.y; ++y) {
-							for (i32 x = xrange.x; x < xrange.y; ++x) {
-								const u32 idx = x + y * size.x + z * size.x * size.y;
-								Cluster& cluster = clusters[idx];
-								f(cluster, i);
-							}
-						}
-					}
+					for_each_pair(i, env_probes[i].pos, length(env_probes[i].outer_range), f);
 				}
 			};
 
 			auto for_each_refl_probe_pair = [&](auto f){
 				for (i32 i = 0, c = refl_probes.size(); i < c; ++i) {
-					const Vec3 p = refl_probes[i].pos;
-					const float r = length(refl_probes[i].half_extents);
-				
-					const IVec2 xrange = range(p, r, size.x, xplanes);
-					const IVec2 yrange = range(p, r, size.y, yplanes);
-					const IVec2 zrange = range(p, r, size.z, zplanes);
-
-					for (i32 z = zrange.x; z < zrange.y; ++z) {
-						for (i32 y = yrange.x; y < yrange.y; ++y) {
-							for (i32 x = xrange.x; x < xrange.y; ++x) {
-								const u32 idx = x + y * size.x + z * size.x * size.y;
-								Cluster& cluster = clusters[idx];
-								f(cluster, i);
-							}
+					for_each_pair(i, refl_probes[i].pos, length(refl_probes[i].half_extents), f);
+				}
+			};
+
+			// lights are binned by depth slice, slices are then filled in parallel,
+			// each cluster belongs to exactly one slice so there are no conflicts
+			const u32 lights_count = point_lights.size();
+			Array<LightClusters> light_clusters(m_frame_allocator);
+			light_clusters.resize(lights_count);
+			jobs::forEach(lights_count, 256, [&](i32 from, i32 to){
+				PROFILE_BLOCK("light ranges");
+				for (i32 i = from; i < to; ++i) {
+					const ClusterPointLight& light = point_lights[i];
+					LightClusters& lc = light_clusters[i];
+					lc.x = range(cluster_xplanes, light.pos, light.radius);
+					lc.y = range(cluster_yplanes, light.pos, light.radius);
+					lc.z = range(cluster_zplanes, light.pos, light.radius);
+					if (lc.x.x < 0 || lc.y.x < 0) lc.z = { -1, -1 };
+				}
+			});
+
+			u32 slice_offsets[lengthOf(zplanes)] = {};
+			for (const LightClusters& lc : light_clusters) {
+				for (i32 z = lc.z.x; z < lc.z.y; ++z) ++slice_offsets[z + 1];
+			}
+			for (i32 z = 0; z < size.z; ++z) slice_offsets[z + 1] += slice_offsets[z];
+			Array<u32> slice_lights(m_frame_allocator);
+			slice_lights.resize(slice_offsets[size.z]);
+			u32 slice_fill[lengthOf(zplanes)];
+			memcpy(slice_fill, slice_offsets, sizeof(slice_fill));
+			for (u32 i = 0; i < lights_count; ++i) {
+				const LightClusters& lc = light_clusters[i];
+				for (i32 z = lc.z.x; z < lc.z.y; ++z) slice_lights[slice_fill[z]++] = i;
+			}
+
+			auto for_each_slice_light_pair = [&](i32 z, auto f){
+				for (u32 j = slice_offsets[z], end = slice_offsets[z + 1]; j < end; ++j) {
+					const u32 light_idx = slice_lights[j];
+					const LightClusters& lc = light_clusters[light_idx];
+					for (i32 y = lc.y.x; y < lc.y.y; ++y) {
+						Cluster* row = &clusters[y * size.x + z * size.x * size.y];
+						for (i32 x = lc.x.x; x < lc.x.y; ++x) {
+							f(row[x], light_idx);
 						}
 					}
 				}
 			};
 
-			for_each_light_pair([](Cluster& cluster, i32 light_idx){
-				++cluster.point_lights_count;
+			jobs::forEach(size.z, 1, [&](i32 from, i32 to){
+				PROFILE_BLOCK("count lights");
+				for (i32 z = from; z < to; ++z) {
+					for_each_slice_light_pair(z, [](Cluster& cluster, u32){
+						++cluster.point_lights_count;
+					});
+				}
 			});
 
 			for_each_env_probe_pair([](Cluster& cluster, i32){
@@ -2816,9 +2936,14 @@ struct PipelineImpl final : Pipeline
 			
 			map.resize(offset);
 			
-			for_each_light_pair([&](Cluster& cluster, i32 light_idx){
-				map[cluster.offset] = light_idx;
-				++cluster.offset;
+			jobs::forEach(size.z, 1, [&](i32 from, i32 to){
+				PROFILE_BLOCK("fill lights");
+				for (i32 z = from; z < to; ++z) {
+					for_each_slice_light_pair(z, [&](Cluster& cluster, u32 light_idx){
+						map[cluster.offset] = light_idx;
+						++cluster.offset;
+					});
+				}
 			});
 
 			for_each_env_probe_pair([&](Cluster& cluster, i32 probe_idx){
@@ -2836,6 +2961,81 @@ struct PipelineImpl final : Pipeline
 			}
 		}
 
+		// clusters along one axis are between neighbouring planes
+		// planes are in SoA so 4 of them can be tested at once, padding planes (n = 0, d = -FLT_MAX) have every point
+		// behind them, which terminates both searches in range() without bounds checks
+		struct ClusterPlanes {
+			void init(const Vec4* planes, i32 count) {
+				size = count;
+				for (i32 i = 0; i < (i32)lengthOf(nx); ++i) {
+					const bool valid = i <= count;
+					nx[i] = valid ? planes[i].x : 0;
+					ny[i] = valid ? planes[i].y : 0;
+					nz[i] = valid ? planes[i].z : 0;
+					d[i] = valid ? planes[i].w : -FLT_MAX;
+				}
+			}
+
+			alignas(16) float nx[68];
+			alignas(16) float ny[68];
+			alignas(16) float nz[68];
+			alignas(16) float d[68];
+			i32 size;
+		};
+
+		struct LightClusters {
+			IVec2 x, y, z;
+		};
+
+		static LUMIX_FORCE_INLINE u32 lowestBit(u32 mask) {
+			ASSERT(mask);
+			#ifdef _WIN32
+				unsigned long res;
+				_BitScanForward(&res, mask);
+				return res;
+			#else
+				return __builtin_ctz(mask);
+			#endif
+		}
+
+		// [from, to) clusters touched by the sphere, {-1, -1} if none
+		static IVec2 range(const ClusterPlanes& planes, const Vec3& p, float r) {
+			const float4 px = f4Splat(p.x);
+			const float4 py = f4Splat(p.y);
+			const float4 pz = f4Splat(p.z);
+			const float4 pos_r = f4Splat(r);
+			const float4 neg_r = f4Splat(-r);
+			auto dist = [&](i32 i){
+				const float4 xy = f4Add(f4Mul(f4Load(&planes.nx[i]), px), f4Mul(f4Load(&planes.ny[i]), py));
+				return f4Add(xy, f4Add(f4Mul(f4Load(&planes.nz[i]), pz), f4Load(&planes.d[i])));
+			};
+
+			float4 d = dist(0);
+			if (f4MoveMask(f4CmpLT(d, neg_r)) & 1) return { -1, -1 };
+
+			// first plane the sphere is not completely in front of, skipping plane 0
+			i32 base = 0;
+			u32 mask = ~f4MoveMask(f4CmpGT(d, pos_r)) & 0b1110;
+			while (!mask) {
+				base += 4;
+				d = dist(base);
+				mask = ~f4MoveMask(f4CmpGT(d, pos_r)) & 0xf;
+			}
+			const i32 from_plane = base + lowestBit(mask);
+			if (from_plane > planes.size) return { -1, -1 };
+
+			// first plane the sphere is completely behind
+			base = from_plane & ~3;
+			d = dist(base);
+			mask = f4MoveMask(f4CmpLT(d, neg_r)) & (0xf << (from_plane & 3)) & 0xf;
+			while (!mask) {
+				base += 4;
+				d = dist(base);
+				mask = f4MoveMask(f4CmpLT(d, neg_r));
+			}
+			return { from_plane - 1, minimum(base + (i32)lowestBit(mask), planes.size) };
+		}
+
 		void execute() override {
 			PROFILE_FUNCTION();
 
@@ -2900,6 +3100,7 @@ struct PipelineImpl final : Pipeline
 			float pad1;
 		};
 
+		LinearAllocator& m_frame_allocator;
 		Array<i32> m_map;
 		Array<Cluster> m_clusters;
 		Array<ClusterPointLight> m_point_lights;
@@ -2972,6 +3173,7 @@ struct PipelineImpl final : Pipeline
 	struct PrepareViewJob : Renderer::RenderJob {
 		PrepareViewJob(IAllocator& allocator)
 			: m_allocator(allocator)
+			, m_instance_gathers(allocator)
 		{
 		}
 		
@@ -2987,8 +3189,29 @@ struct PipelineImpl final : Pipeline
 			IVec4 indices_count[32];
 		};
 
+		void gatherInstances() {
+			if (m_instance_gathers.empty()) return;
+
+			m_pipeline->m_renderer.beginProfileBlock("gather instances", 0);
+			const gpu::BufferHandle output = m_pipeline->m_instance_gather_buffer;
+			gpu::bindShaderBuffer(m_instance_store, 1, gpu::BindShaderBufferFlags::NONE);
+			gpu::bindShaderBuffer(output, 2, gpu::BindShaderBufferFlags::OUTPUT);
+			gpu::useProgram(m_instance_gather_shader);
+			for (const InstanceGather& gather : m_instance_gathers) {
+				gpu::bindUniformBuffer(UniformBuffer::DRAWCALL, gather.ub.buffer, gather.ub.offset, gather.ub.size);
+				gpu::bindShaderBuffer(gather.input.buffer, 0, gpu::BindShaderBufferFlags::NONE);
+				gpu::dispatch((gather.count + 255) / 256, 1, 1);
+			}
+			gpu::memoryBarrier(gpu::MemoryBarrierType::VERTEX_ATTRIB, output);
+			gpu::bindShaderBuffer(gpu::INVALID_BUFFER, 0, gpu::BindShaderBufferFlags::NONE);
+			gpu::bindShaderBuffer(gpu::INVALID_BUFFER, 1, gpu::BindShaderBufferFlags::NONE);
+			gpu::bindShaderBuffer(gpu::INVALID_BUFFER, 2, gpu::BindShaderBufferFlags::NONE);
+			m_pipeline->m_renderer.endProfileBlock();
+		}
+
 		void execute() override {
 			PROFILE_FUNCTION();
+			gatherInstances();
 			if (!m_instanced_meshes) return;
 			if (m_instanced_meshes->models.empty()) return;
 
@@ -3054,6 +3277,20 @@ struct PipelineImpl final : Pipeline
 			m_pipeline->m_renderer.endProfileBlock();
 		}
 
+		// first view of a batch culls all of them, the others wait for it
+		void cullBatch() {
+			PROFILE_FUNCTION();
+			const Array<View*>& views = m_cull_batch->views;
+			Array<ShiftedFrustum> frusta(m_allocator);
+			Array<CullResult*> results(m_allocator);
+			frusta.reserve(views.size());
+			results.resize(views.size());
+			for (View* view : views) frusta.push(view->cp.frustum);
+			m_pipeline->m_scene->getRenderables(frusta, results);
+			for (i32 i = 0; i < views.size(); ++i) views[i]->renderables = results[i];
+			jobs::setGreen(&m_cull_batch->culled);
+		}
+
 		static float getDrawDistance(const Model& model) {
 			const LODMeshIndices* lod_indices = model.getLODIndices();
 			float dist = 0;
@@ -3110,14 +3347,32 @@ struct PipelineImpl final : Pipeline
 
 			setupFur();
 
-			m_view->renderables = m_pipeline->m_scene->getRenderables(m_view->cp.frustum);
+			if (!m_cull_batch) {
+				m_view->renderables = m_pipeline->m_scene->getRenderables(m_view->cp.frustum);
+			}
+			else if (m_cull_batch->views[0] == m_view) {
+				cullBatch();
+			}
+			else {
+				jobs::wait(&m_cull_batch->culled);
+			}
 			const float global_lod_multiplier = m_pipeline->m_renderer.getLODMultiplier();
 			
 			if (m_view->renderables) {
+				if (m_pipeline->m_occlusion_culling && !m_view->cp.is_shadow) {
+					m_pipeline->cullOccluded(*m_view);
+				}
 				m_pipeline->createSortKeys(*m_view);
+				for (const AutoInstancer& instancer : m_view->instancers) {
+					if (instancer.gather.count > 0) m_instance_gathers.push(instancer.gather);
+				}
+				if (!m_instance_gathers.empty()) {
+					m_instance_gather_shader = m_pipeline->m_instance_gather_program;
+					m_instance_store = m_pipeline->m_scene->getModelInstanceStore().buffer;
+				}
 				m_view->renderables->free(m_pipeline->m_renderer.getEngine().getPageAllocator());
 				if (!m_view->sorter.keys.empty()) {
-					m_pipeline->radixSort(m_view->sorter.keys.begin(), m_view->sorter.values.begin(), m_view->sorter.keys.size());
+					jobs::radixSort(m_view->sorter.keys.begin(), m_view->sorter.values.begin(), m_view->sorter.keys.size());
 					m_pipeline->createCommands(*m_view);
 				}
 			}
@@ -3215,6 +3470,13 @@ struct PipelineImpl final : Pipeline
 
 					g.drawcall_ub = m_pipeline->m_renderer.allocUniform(sizeof(ub_values));
 					memcpy(g.drawcall_ub.ptr, &ub_values, sizeof(ub_values));
+
+					// instance in lod transition is written twice
+					u32 visible_count = 0;
+					for (u32 i = 0; i < g.cell_count; ++i) {
+						if (g.cells[i].visible) visible_count += g.cells[i].count;
+					}
+					atomicAdd(m_instanced_meshes_required, i32(visible_count * 2 * INSTANCED_MESH_DATA_SIZE));
 				}
 			}
 			jobs::setGreen(&m_view->ready);
@@ -3225,30 +3487,29 @@ struct PipelineImpl final : Pipeline
 		CameraParams m_camera_params;
 		u32 m_define_mask = 0;
 		InstancedMeshes* m_instanced_meshes = nullptr;
+		volatile i32* m_instanced_meshes_required = nullptr;
 		gpu::ProgramHandle m_gather_shader;
 		gpu::ProgramHandle m_indirect_shader;
 		gpu::ProgramHandle m_cull_shader;
 		gpu::ProgramHandle m_init_shader;
 		gpu::ProgramHandle m_update_lods_shader;
+		gpu::ProgramHandle m_instance_gather_shader = gpu::INVALID_PROGRAM;
+		gpu::BufferHandle m_instance_store = gpu::INVALID_BUFFER;
+		Array<InstanceGather> m_instance_gathers;
 		View* m_view;
+		CullBatch* m_cull_batch = nullptr;
 	};
 
-	static int cull(lua_State* L) {
-		const CameraParams cp = LuaWrapper::checkArg<CameraParams>(L, 1);
-		PipelineImpl* pipeline = getClosureThis(L);
-		const i32 bucket_count = lua_gettop(L) - 1;
-		for (i32 i = 0; i < bucket_count; ++i) LuaWrapper::checkTableArg(L, 2 + i);
-		
-		PROFILE_FUNCTION();
-		Array<UniquePtr<View>>& views = pipeline->m_views;
-		UniquePtr<View>& view = views.emplace();
-		LinearAllocator& allocator = pipeline->m_renderer.getCurrentFrameAllocator();
+	// creates a view with buckets from lua args 2..., pushes its table with bucket ids; the returned job is not queued yet
+	PrepareViewJob& createView(lua_State* L, const CameraParams& cp, i32 bucket_count) {
+		UniquePtr<View>& view = m_views.emplace();
+		LinearAllocator& allocator = m_renderer.getCurrentFrameAllocator();
 		view = UniquePtr<View>::create(allocator
 			, allocator
-			, pipeline->m_renderer.getEngine().getPageAllocator());
+			, m_renderer.getEngine().getPageAllocator());
 		view->cp = cp;
-		if (views.size() > 1) {
-			views[views.size() - 2]->instanced_meshes->next = view->instanced_meshes;
+		if (m_views.size() > 1) {
+			m_views[m_views.size() - 2]->instanced_meshes->next = view->instanced_meshes;
 		}
 		memset(view->layer_to_bucket, 0xff, sizeof(view->layer_to_bucket));
 
@@ -3262,7 +3523,7 @@ struct PipelineImpl final : Pipeline
 				LuaWrapper::argError(L, 2 + i, "layer name `view` is reserved");
 			}
 			Bucket& bucket = view->buckets.emplace();
-			bucket.layer = pipeline->m_renderer.getLayerIdx(layer);
+			bucket.layer = m_renderer.getLayerIdx(layer);
 			copyString(Span(bucket.layer_name), layer); 
 			
 			char sort[32];
@@ -3272,7 +3533,7 @@ struct PipelineImpl final : Pipeline
 
 			char define[32];
 			if (LuaWrapper::getOptionalStringField(L, 2 + i, "define", Span(define))) {
-				bucket.define_mask = 1 << pipeline->m_renderer.getShaderDefineIdx(define);
+				bucket.define_mask = 1 << m_renderer.getShaderDefineIdx(define);
 			}
 		}
 
@@ -3281,37 +3542,89 @@ struct PipelineImpl final : Pipeline
 			view->layer_to_bucket[bucket.layer] = i;
 		}
 
-		PrepareViewJob& job = pipeline->m_renderer.createJob<PrepareViewJob>(allocator);
-		job.m_pipeline = pipeline;
+		PrepareViewJob& job = m_renderer.createJob<PrepareViewJob>(allocator);
+		job.m_pipeline = this;
 		job.m_camera_params = cp;
 		job.m_view = view.get();
 
-		if (pipeline->m_instancing_shader->isReady()) {
-			const HashMap<EntityRef, InstancedModel>& ims = pipeline->m_scene->getInstancedModels();
+		if (m_instancing_shader->isReady()) {
+			const HashMap<EntityRef, InstancedModel>& ims = m_scene->getInstancedModels();
 			for (auto iter = ims.begin(), end = ims.end(); iter != end; ++iter) {
 				if (iter.value().dirty) {
-					pipeline->m_scene->initInstancedModelGPUData(iter.key());
+					m_scene->initInstancedModelGPUData(iter.key());
 				}
 			}
 
 			job.m_instanced_meshes = view->instanced_meshes;
-			job.m_gather_shader = pipeline->m_instancing_shader->getProgram(1 << pipeline->m_renderer.getShaderDefineIdx("PASS3"));
-			job.m_indirect_shader = pipeline->m_instancing_shader->getProgram(1 << pipeline->m_renderer.getShaderDefineIdx("PASS2"));
-			u32 cull_shader_defines = 1 << pipeline->m_renderer.getShaderDefineIdx("PASS1");
-			if (!cp.is_shadow) cull_shader_defines |= 1 << pipeline->m_renderer.getShaderDefineIdx("UPDATE_LODS");
-			job.m_cull_shader = pipeline->m_instancing_shader->getProgram(cull_shader_defines);
-			job.m_init_shader = pipeline->m_instancing_shader->getProgram(1 << pipeline->m_renderer.getShaderDefineIdx("PASS0"));
-			job.m_update_lods_shader = pipeline->m_instancing_shader->getProgram(1 << pipeline->m_renderer.getShaderDefineIdx("UPDATE_LODS"));
+			job.m_instanced_meshes_required = m_instanced_meshes_required;
+			job.m_gather_shader = m_instancing_shader->getProgram(1 << m_renderer.getShaderDefineIdx("PASS3"));
+			job.m_indirect_shader = m_instancing_shader->getProgram(1 << m_renderer.getShaderDefineIdx("PASS2"));
+			u32 cull_shader_defines = 1 << m_renderer.getShaderDefineIdx("PASS1");
+			if (!cp.is_shadow) cull_shader_defines |= 1 << m_renderer.getShaderDefineIdx("UPDATE_LODS");
+			job.m_cull_shader = m_instancing_shader->getProgram(cull_shader_defines);
+			job.m_init_shader = m_instancing_shader->getProgram(1 << m_renderer.getShaderDefineIdx("PASS0"));
+			job.m_update_lods_shader = m_instancing_shader->getProgram(1 << m_renderer.getShaderDefineIdx("UPDATE_LODS"));
 		}
 		jobs::setRed(&view->ready);
-		pipeline->m_renderer.queue(job, pipeline->m_profiler_link);
 
 		lua_newtable(L);
-		const u32 view_id = pipeline->m_views.size() - 1;
+		const u32 view_id = m_views.size() - 1;
 		LuaWrapper::setField(L, -1, "view", view_id);
 		for (u32 i = 0; i < (u32)view->buckets.size(); ++i) {
 			LuaWrapper::setField(L, -1, view->buckets[i].layer_name, (view_id << 16) | i);
 		}
+		return job;
+	}
+
+	// cull(view_params, buckets...) returns a table with bucket ids
+	// cull({view_params, ...}, buckets...) culls all views in one pass and returns an array of such tables
+	static int cull(lua_State* L) {
+		LuaWrapper::checkTableArg(L, 1);
+		PipelineImpl* pipeline = getClosureThis(L);
+		const i32 bucket_count = lua_gettop(L) - 1;
+		for (i32 i = 0; i < bucket_count; ++i) LuaWrapper::checkTableArg(L, 2 + i);
+		
+		PROFILE_FUNCTION();
+		lua_rawgeti(L, 1, 1);
+		const bool is_batch = lua_istable(L, -1);
+		lua_pop(L, 1);
+
+		if (!is_batch) {
+			const CameraParams cp = LuaWrapper::checkArg<CameraParams>(L, 1);
+			PrepareViewJob& job = pipeline->createView(L, cp, bucket_count);
+			pipeline->m_renderer.queue(job, pipeline->m_profiler_link);
+			return 1;
+		}
+
+		const i32 view_count = (i32)lua_objlen(L, 1);
+		LinearAllocator& allocator = pipeline->m_renderer.getCurrentFrameAllocator();
+		UniquePtr<CullBatch>& batch = pipeline->m_cull_batches.emplace();
+		batch = UniquePtr<CullBatch>::create(allocator, allocator);
+		batch->views.reserve(view_count);
+		Array<PrepareViewJob*> batch_jobs(allocator);
+		batch_jobs.reserve(view_count);
+
+		lua_createtable(L, view_count, 0);
+		for (i32 i = 0; i < view_count; ++i) {
+			lua_rawgeti(L, 1, i + 1);
+			if (!LuaWrapper::isType<CameraParams>(L, -1)) {
+				LuaWrapper::argError(L, 1, "expected array of camera params");
+			}
+			const CameraParams cp = LuaWrapper::toType<CameraParams>(L, lua_gettop(L));
+			lua_pop(L, 1);
+
+			PrepareViewJob& job = pipeline->createView(L, cp, bucket_count);
+			lua_rawseti(L, -2, i + 1);
+			job.m_cull_batch = batch.get();
+			batch->views.push(job.m_view);
+			batch_jobs.push(&job);
+		}
+
+		// queue only after the batch is complete, the first job culls all views in it
+		if (!batch_jobs.empty()) jobs::setRed(&batch->culled);
+		for (PrepareViewJob* job : batch_jobs) {
+			pipeline->m_renderer.queue(*job, pipeline->m_profiler_link);
+		}
 		return 1;
 	}
 
@@ -3380,7 +3693,7 @@ struct PipelineImpl final : Pipeline
 
 						gpu::bindIndexBuffer(m.mesh_rd->index_buffer_handle);
 						gpu::bindVertexBuffer(0, m.mesh_rd->vertex_buffer_handle, 0, m.mesh_rd->vb_stride);
-						gpu::bindVertexBuffer(1, m_pipeline->m_instanced_meshes_buffer, 48, 32);
+						gpu::bindVertexBuffer(1, m_pipeline->m_instanced_meshes_buffer, INSTANCED_MESHES_HEADER_SIZE, INSTANCED_MESH_DATA_SIZE);
 
 						gpu::bindIndirectBuffer(m_pipeline->m_indirect_buffer);
 
@@ -3529,6 +3842,7 @@ struct PipelineImpl final : Pipeline
 						gpu::bindVertexBuffer(0, cmd->mesh->vertex_buffer_handle, 0, cmd->mesh->vb_stride);
 						gpu::bindVertexBuffer(1, gpu::INVALID_BUFFER, 0, 0);
 							
+						gpu::bindShaderBuffer(cmd->bones_buffer, 10, gpu::BindShaderBufferFlags::NONE);
 						gpu::bindUniformBuffer(UniformBuffer::DRAWCALL, cmd->ub_buffer, cmd->ub_offset, cmd->ub_size);
 						gpu::drawIndexedInstanced(gpu::PrimitiveType::TRIANGLES, cmd->mesh->indices_count, cmd->layers, cmd->mesh->index_type);
 						break;
@@ -3623,6 +3937,153 @@ struct PipelineImpl final : Pipeline
 		StackArray<Procedural, 16> m_procedurals;
 	};
 
+	void updateLODCache() {
+		const float multiplier = m_renderer.getLODMultiplier();
+		m_lod_cache.travel += (float)length(m_viewport.pos - m_lod_cache.ref_point);
+		m_lod_cache.ref_point = m_viewport.pos;
+		// keep travel small enough so expiration is precise
+		if (multiplier != m_lod_cache.multiplier || m_lod_cache.travel > 65536) {
+			m_lod_cache.entries.clear();
+			m_lod_cache.travel = 0;
+			m_lod_cache.multiplier = multiplier;
+		}
+		const u32 count = m_scene->getModelInstances().length();
+		const u32 old_count = m_lod_cache.entries.size();
+		if (old_count < count) {
+			m_lod_cache.entries.resize(count);
+			memset(m_lod_cache.entries.begin() + old_count, 0, (count - old_count) * sizeof(u64));
+		}
+	}
+
+	// uploads transforms of model instances created or moved since the last flush
+	// the store is shared by all pipelines of the scene, the first one to render in a frame does the upload
+	void flushModelInstanceStore() {
+		PROFILE_FUNCTION();
+		ModelInstanceStore& store = m_scene->getModelInstanceStore();
+		Span<const ModelInstance> model_instances = m_scene->getModelInstances();
+		if (store.capacity < model_instances.length()) {
+			if (store.buffer) m_renderer.destroy(store.buffer);
+			store.capacity = nextPow2(model_instances.length());
+			const Renderer::MemRef mem = { store.capacity * ModelInstanceStore::STRIDE, nullptr, false };
+			store.buffer = m_renderer.createBuffer(mem, gpu::BufferFlags::COMPUTE_WRITE | gpu::BufferFlags::SHADER_BUFFER);
+			for (u32 i = 0, c = model_instances.length(); i < c; ++i) {
+				if (model_instances[i].flags.isSet(ModelInstance::VALID)) store.markDirty({(i32)i});
+			}
+		}
+		if (store.dirty.empty()) return;
+
+		profiler::pushInt("count", store.dirty.size());
+		const Transform* transforms = m_scene->getUniverse().getTransforms();
+		const Renderer::TransientSlice input = m_renderer.allocTransient(store.dirty.size() * ModelInstanceStore::STRIDE);
+		Vec4* data = (Vec4*)input.ptr;
+		u32 count = 0;
+		for (EntityRef e : store.dirty) {
+			store.dirty_mask[e.index] = 0;
+			if (e.index >= (i32)model_instances.length()) continue;
+			if (!model_instances[e.index].flags.isSet(ModelInstance::VALID)) continue;
+
+			const Transform& tr = transforms[e.index];
+			// double precision position split to two floats
+			const Vec3 pos_hi = Vec3(tr.pos);
+			const Vec3 pos_lo = Vec3(tr.pos - DVec3(pos_hi));
+			data[0] = packRotationLOD(tr.rot, tr.scale);
+			data[1] = Vec4(pos_hi, 0);
+			data[2] = Vec4(pos_lo, 0);
+			// slot is read as uint by the shader, it would be a denormal as float
+			memcpy(&data[1].w, &e.index, sizeof(e.index));
+			data += 3;
+			++count;
+		}
+		store.dirty.clear();
+		if (count == 0) return;
+
+		struct ScatterJob : Renderer::RenderJob {
+			void setup() override {}
+			void execute() override {
+				PROFILE_FUNCTION();
+				gpu::bindUniformBuffer(UniformBuffer::DRAWCALL, ub.buffer, ub.offset, ub.size);
+				gpu::bindShaderBuffer(input, 0, gpu::BindShaderBufferFlags::NONE);
+				gpu::bindShaderBuffer(store, 1, gpu::BindShaderBufferFlags::OUTPUT);
+				gpu::useProgram(program);
+				gpu::dispatch((count + 255) / 256, 1, 1);
+				gpu::memoryBarrier(gpu::MemoryBarrierType::SSBO, store);
+				gpu::bindShaderBuffer(gpu::INVALID_BUFFER, 0, gpu::BindShaderBufferFlags::NONE);
+				gpu::bindShaderBuffer(gpu::INVALID_BUFFER, 1, gpu::BindShaderBufferFlags::NONE);
+			}
+
+			gpu::BufferHandle input;
+			gpu::BufferHandle store;
+			gpu::ProgramHandle program;
+			Renderer::TransientSlice ub;
+			u32 count;
+		};
+
+		InstanceStoreUB ub = {};
+		ub.input_offset = input.offset / sizeof(Vec4);
+		ub.count = count;
+
+		ScatterJob& job = m_renderer.createJob<ScatterJob>();
+		job.input = input.buffer;
+		job.store = store.buffer;
+		job.program = m_instance_store_shader->getProgram(1 << m_renderer.getShaderDefineIdx("SCATTER"));
+		job.ub = m_renderer.allocUniform(sizeof(ub));
+		job.count = count;
+		memcpy(job.ub.ptr, &ub, sizeof(ub));
+		m_renderer.queue(job, 0);
+	}
+
+	// computes bone palettes of all skinned model instances, views reference them by offset
+	// shared by all pipelines of the scene, the first one to render in a frame does the work
+	void updateSkinningPalettes() {
+		SkinningPalettes& palettes = m_scene->getSkinningPalettes();
+		const u32 frame = m_renderer.frameNumber();
+		if (palettes.frame == frame) return;
+
+		PROFILE_FUNCTION();
+		palettes.frame = frame;
+		palettes.buffer = gpu::INVALID_BUFFER;
+		Span<const ModelInstance> model_instances = m_scene->getModelInstances();
+		palettes.offsets.resize(model_instances.length());
+
+		Array<EntityRef> entities(m_allocator);
+		u32 bones_count = 0;
+		for (u32 i = 0, c = model_instances.length(); i < c; ++i) {
+			const ModelInstance& mi = model_instances[i];
+			palettes.offsets[i] = SkinningPalettes::INVALID_OFFSET;
+			if (!mi.pose || !mi.flags.isSet(ModelInstance::ENABLED)) continue;
+			if (!mi.model->isSkinned()) continue;
+
+			palettes.offsets[i] = bones_count * 2;
+			bones_count += mi.pose->count;
+			entities.push({(i32)i});
+		}
+		if (entities.empty()) return;
+
+		profiler::pushInt("count", entities.size());
+		profiler::pushInt("bones", bones_count);
+		const Renderer::TransientSlice slice = m_renderer.allocTransient(bones_count * sizeof(DualQuat));
+		palettes.buffer = slice.buffer;
+		const u32 slice_offset = slice.offset / sizeof(Vec4);
+		for (EntityRef e : entities) palettes.offsets[e.index] += slice_offset;
+
+		jobs::forEach(entities.size(), 16, [&](i32 from, i32 to){
+			PROFILE_BLOCK("skinning palettes");
+			for (i32 i = from; i < to; ++i) {
+				const EntityRef e = entities[i];
+				const ModelInstance& mi = model_instances[e.index];
+				const Model& model = *mi.model;
+				const Quat* rotations = mi.pose->rotations;
+				const Vec3* positions = mi.pose->positions;
+				DualQuat* LUMIX_RESTRICT palette = (DualQuat*)(slice.ptr + (palettes.offsets[e.index] - slice_offset) * sizeof(Vec4));
+				for (u32 j = 0, c = mi.pose->count; j < c; ++j) {
+					const Model::Bone& bone = model.getBone(j);
+					const LocalRigidTransform tmp = {positions[j], rotations[j]};
+					palette[j] = (tmp * bone.inv_bind_transform).toDualQuat();
+				}
+			}
+		});
+	}
+
 	static Vec4 packRotationLOD(const Quat& rot, float lod) {
 		return rot.w > 0 ? Vec4(rot.x, rot.y, rot.z, lod) : Vec4(-rot.x, -rot.y, -rot.z, lod);
 	}
@@ -3683,8 +4144,8 @@ struct PipelineImpl final : Pipeline
 		Mesh::RenderData* mesh;
 		Material::RenderData* material;
 		gpu::ProgramHandle program;
-		u32 bone_count;
 		u32 layers;
+		gpu::BufferHandle bones_buffer;
 		gpu::BufferHandle ub_buffer;
 		u32 ub_offset;
 		u32 ub_size;
@@ -3706,6 +4167,11 @@ struct PipelineImpl final : Pipeline
 		u32 offset;
 	};
 
+	// consecutive meshes with equal masked sort keys are merged into a single instanced draw call
+	static u64 getInstanceKeyMask(const Bucket& bucket) {
+		return bucket.sort == Bucket::DEPTH ? 0xff00'0000'00ff'ffff : 0xffff'ffff'0000'0000;
+	}
+
 	CmdPage* createCommands(View& view
 		, const u64* LUMIX_RESTRICT renderables
 		, const u64* LUMIX_RESTRICT sort_keys
@@ -3745,8 +4211,7 @@ struct PipelineImpl final : Pipeline
 				instanced_define_mask = define_mask | (1 << renderer.getShaderDefineIdx("INSTANCED"));
 				skinned_define_mask = define_mask | (1 << renderer.getShaderDefineIdx("SKINNED"));
 				fur_define_mask = define_mask | (1 << renderer.getShaderDefineIdx("FUR"));
-				const bool sort_depth = view.buckets[bucket].sort == Bucket::DEPTH;
-				instance_key_mask = sort_depth ? 0xff00'0000'00ff'ffff : 0xffff'ffff'0000'0000;
+				instance_key_mask = getInstanceKeyMask(view.buckets[bucket]);
 			}
 
 			switch(type) {
@@ -3840,6 +4305,10 @@ struct PipelineImpl final : Pipeline
 				}
 				case RenderableTypes::FUR:
 				case RenderableTypes::SKINNED: {
+					const SkinningPalettes& palettes = m_scene->getSkinningPalettes();
+					// palettes are computed before views, instances made skinned since then are skipped this frame
+					if (e.index >= palettes.offsets.size() || palettes.offsets[e.index] == SkinningPalettes::INVALID_OFFSET) break;
+
 					const u32 mesh_idx = renderables[i] >> 40;
 					const ModelInstance* LUMIX_RESTRICT mi = &model_instances[e.index];
 					const Transform& tr = entity_data[e.index];
@@ -3853,25 +4322,20 @@ struct PipelineImpl final : Pipeline
 					cmd->mesh = mesh.render_data;
 					cmd->material = mesh.material->getRenderData();
 					cmd->program = shader->getProgram(mesh.vertex_decl, defines);
-					cmd->bone_count = mi->pose->count;
-
-					const Quat* rotations = mi->pose->rotations;
-					const Vec3* positions = mi->pose->positions;
-
-					Model& model = *mi->model;
 
 					struct UBPrefix {
 						float fur_scale;
 						float gravity;
 						float layers;
-						float padding;
+						u32 bones_offset;
 						Matrix model_mtx;
 					};
 
-					Renderer::TransientSlice ub = renderer.allocUniform(sizeof(DualQuat) * mi->pose->count + sizeof(UBPrefix));
+					Renderer::TransientSlice ub = renderer.allocUniform(sizeof(UBPrefix));
 					UBPrefix* prefix = (UBPrefix*)ub.ptr;
 					prefix->model_mtx = Matrix(rel_pos, tr.rot);
 					prefix->model_mtx.multiply3x3(tr.scale);
+					prefix->bones_offset = palettes.offsets[e.index];
 
 					u32 layers = 1;
 					if (type == RenderableTypes::FUR) {
@@ -3881,15 +4345,9 @@ struct PipelineImpl final : Pipeline
 						prefix->gravity = fur.gravity;
 					}
 					prefix->layers = float(layers);
-
-					DualQuat* bones_ub_array = (DualQuat*)(ub.ptr + sizeof(UBPrefix));
-					for (int j = 0, c = mi->pose->count; j < c; ++j) {
-						const Model::Bone& bone = model.getBone(j);
-						const LocalRigidTransform tmp = {positions[j], rotations[j]};
-						bones_ub_array[j] = (tmp * bone.inv_bind_transform).toDualQuat();
-					}
 					
 					cmd->layers = layers;
+					cmd->bones_buffer = palettes.buffer;
 					cmd->ub_buffer = ub.buffer;
 					cmd->ub_offset = ub.offset;
 					cmd->ub_size = ub.size;
@@ -4054,14 +4512,34 @@ struct PipelineImpl final : Pipeline
 			STEP = (size + jobs::getWorkersCount() - 1) / jobs::getWorkersCount();
 			steps = (size + STEP - 1) / STEP;
 		}
-		PageAllocator& page_allocator = m_renderer.getEngine().getPageAllocator();
+
+		// chunk must not split a run of mergeable meshes, it would end as several draw calls
+		StackArray<i32, 65> bounds(m_allocator);
+		bounds.push(0);
+		i32 b = 0;
+		for (i32 i = 1; i < steps; ++i) {
+			if (b >= i * STEP) continue;
+			b = i * STEP;
+			while (b < size) {
+				const u8 bucket = u8(sort_keys[b] >> SORT_KEY_BUCKET_SHIFT);
+				const u64 mask = getInstanceKeyMask(view.buckets[bucket]);
+				if ((sort_keys[b] & mask) != (sort_keys[b - 1] & mask)) break;
+				++b;
+			}
+			if (b >= size) break;
+			bounds.push(b);
+		}
+		bounds.push(size);
+		profiler::pushInt("Chunks", bounds.size() - 1);
 
 		StackArray<CmdPage*, 64> pages(m_allocator);
-		pages.resize(steps);
+		pages.resize(bounds.size() - 1);
 
-		jobs::forEach(size, STEP, [&](i32 from, i32 to){
-			const u32 step = from / STEP;
-			pages[step] = createCommands(view, renderables + from, sort_keys + from, to - from);
+		jobs::forEach(pages.size(), 1, [&](i32 from, i32 to){
+			for (i32 chunk = from; chunk < to; ++chunk) {
+				const i32 offset = bounds[chunk];
+				pages[chunk] = createCommands(view, renderables + offset, sort_keys + offset, bounds[chunk + 1] - offset);
+			}
 		});
 
 		CmdPage* prev = nullptr;
@@ -4552,6 +5030,80 @@ struct PipelineImpl final : Pipeline
 		u32 m_define_mask = 0;
 	};
 
+	void setOcclusionCulling(bool enable) {
+		m_occlusion_culling = enable;
+	}
+
+	static bool isOcclusionTested(RenderableTypes type) {
+		// skinned meshes can leave model's AABB
+		return type == RenderableTypes::MESH || type == RenderableTypes::MESH_MATERIAL_OVERRIDE;
+	}
+
+	static Matrix getRelativeMatrix(const Transform& tr, const DVec3& camera_pos) {
+		Matrix mtx = tr.rot.toMatrix();
+		mtx.multiply3x3(tr.scale);
+		mtx.setTranslation(Vec3(tr.pos - camera_pos));
+		return mtx;
+	}
+
+	// rasterizes visible occluders and removes meshes hidden behind them from view's renderables
+	void cullOccluded(View& view) {
+		PROFILE_FUNCTION();
+		const ModelInstance* LUMIX_RESTRICT model_instances = m_scene->getModelInstances().begin();
+		const Transform* LUMIX_RESTRICT transforms = m_scene->getUniverse().getTransforms();
+		const DVec3 camera_pos = view.cp.pos;
+		const Matrix view_projection = view.cp.projection * view.cp.view;
+
+		jobs::MutexGuard guard(m_occlusion_mutex);
+		m_occlusion_buffer.clear();
+		for (const CullResult* page = view.renderables; page; page = page->header.next) {
+			if (!isOcclusionTested((RenderableTypes)page->header.type)) continue;
+			for (u32 i = 0, c = page->header.count; i < c; ++i) {
+				const EntityRef e = page->entities[i];
+				const ModelInstance& mi = model_instances[e.index];
+				if (!mi.flags.isSet(ModelInstance::OCCLUDER)) continue;
+
+				const Model* model = mi.model;
+				const LODMeshIndices* lods = model->getLODIndices();
+				u32 lod_idx = 0;
+				while (lod_idx + 1 < Model::MAX_LOD_COUNT && lods[lod_idx + 1].to >= 0) ++lod_idx;
+				
+				const Matrix mvp = view_projection * getRelativeMatrix(transforms[e.index], camera_pos);
+				for (i32 mesh_idx = lods[lod_idx].from; mesh_idx <= lods[lod_idx].to; ++mesh_idx) {
+					const Mesh& mesh = model->getMesh(mesh_idx);
+					const u32 indices_count = u32(mesh.indices.size() / (mesh.areIndices16() ? sizeof(u16) : sizeof(u32)));
+					m_occlusion_buffer.addOccluder(mvp, mesh.vertices, mesh.indices.data(), indices_count, mesh.areIndices16());
+				}
+			}
+		}
+		if (!m_occlusion_buffer.hasOccluders()) return;
+
+		m_occlusion_buffer.rasterize();
+
+		PagedListIterator<CullResult> iterator(view.renderables);
+		jobs::runOnWorkers([&](){
+			PROFILE_BLOCK("occlusion test");
+			u32 occluded = 0;
+			for (;;) {
+				CullResult* page = iterator.next();
+				if (!page) break;
+				if (!isOcclusionTested((RenderableTypes)page->header.type)) continue;
+
+				u32 count = 0;
+				for (u32 i = 0, c = page->header.count; i < c; ++i) {
+					const EntityRef e = page->entities[i];
+					const Matrix mvp = view_projection * getRelativeMatrix(transforms[e.index], camera_pos);
+					if (m_occlusion_buffer.isOccluded(mvp, model_instances[e.index].model->getAABB())) continue;
+					page->entities[count] = e;
+					++count;
+				}
+				occluded += page->header.count - count;
+				page->header.count = count;
+			}
+			profiler::pushInt("occluded", occluded);
+		});
+	}
+
 	void createSortKeys(PipelineImpl::View& view) {
 		if (view.renderables->header.count == 0 && !view.renderables->header.next) return;
 		PagedListIterator<const CullResult> iterator(view.renderables);
@@ -4591,6 +5143,41 @@ struct PipelineImpl final : Pipeline
 			AutoInstancer& instancer = view.instancers[instancer_idx];
 			instancer.init(m_renderer.getMaxSortKey() + 1);
 
+			u64* LUMIX_RESTRICT lod_cache = m_lod_cache.entries.begin();
+			const u32 lod_cache_size = m_lod_cache.entries.size();
+			const u32* LUMIX_RESTRICT versions = scene->getModelInstanceStore().versions.begin();
+			const float travel = m_lod_cache.travel;
+			u32 lod_cache_hits = 0;
+			u32 lod_cache_misses = 0;
+			auto getLOD = [&](EntityRef e, const Model& model) -> u32 {
+				if ((u32)e.index < lod_cache_size) {
+					const u64 entry = atomicLoadRelaxed(&lod_cache[e.index]);
+					float expires;
+					memcpy(&expires, &entry, sizeof(expires));
+					if (travel < expires && u32(entry >> 35) == (versions[e.index] & 0x1fffFFFF)) {
+						++lod_cache_hits;
+						return u32(entry >> 32) & 7;
+					}
+				}
+
+				++lod_cache_misses;
+				const float squared_length = float(squaredLength(entity_data[e.index].pos - lod_ref_point));
+				const u32 lod = model.getLODMeshIndices(squared_length * global_lod_multiplier_rcp);
+				if ((u32)e.index >= lod_cache_size) return lod;
+
+				// distance to the nearest LOD boundary
+				const float* lod_distances = model.getLODDistances();
+				const float d = sqrtf(squared_length);
+				float margin = FLT_MAX;
+				if (lod > 0) margin = d - sqrtf(maximum(lod_distances[lod - 1] * global_lod_multiplier, 0.f));
+				if (lod < 4) margin = minimum(margin, sqrtf(maximum(lod_distances[lod] * global_lod_multiplier, 0.f)) - d);
+				const float expires = travel + margin;
+				u32 expires_bits;
+				memcpy(&expires_bits, &expires, sizeof(expires_bits));
+				atomicStoreRelaxed(&lod_cache[e.index], expires_bits | ((u64)((versions[e.index] << 3) | lod) << 32));
+				return lod;
+			};
+
 			for(;;) {
 				const CullResult* page = iterator.next();
 				if(!page) break;
@@ -4636,11 +5223,8 @@ struct PipelineImpl final : Pipeline
 					case RenderableTypes::MESH_MATERIAL_OVERRIDE: {
 						for (int i = 0, c = page->header.count; i < c; ++i) {
 							const EntityRef e = renderables[i];
-							const DVec3 pos = entity_data[e.index].pos;
 							ModelInstance& mi = model_instances[e.index];
-							const float squared_length = float(squaredLength(pos - lod_ref_point));
-								
-							const u32 lod_idx = mi.model->getLODMeshIndices(squared_length * global_lod_multiplier_rcp);
+							const u32 lod_idx = getLOD(e, *mi.model);
 
 							auto create_key = [&](const LODMeshIndices& lod){
 								for (int mesh_idx = lod.from; mesh_idx <= lod.to; ++mesh_idx) {
@@ -4696,11 +5280,8 @@ struct PipelineImpl final : Pipeline
 						const bool is_shadow = view.cp.is_shadow;
 						for (int i = 0, c = page->header.count; i < c; ++i) {
 							const EntityRef e = renderables[i];
-							const DVec3 pos = entity_data[e.index].pos;
 							ModelInstance& mi = model_instances[e.index];
-							const float squared_length = float(squaredLength(pos - lod_ref_point));
-								
-							const u32 lod_idx = mi.model->getLODMeshIndices(squared_length * global_lod_multiplier_rcp);
+							const u32 lod_idx = getLOD(e, *mi.model);
 
 							auto create_key = [&](const LODMeshIndices& lod){
 								for (int mesh_idx = lod.from; mesh_idx <= lod.to; ++mesh_idx) {
@@ -4747,6 +5328,8 @@ struct PipelineImpl final : Pipeline
 				}
 			}
 			profiler::pushInt("count", total);
+			profiler::pushInt("LOD cache hits", lod_cache_hits);
+			profiler::pushInt("LOD cache misses", lod_cache_misses);
 
 			const Mesh** sort_key_to_mesh = m_renderer.getSortKeyToMeshMap();
 			for (u32 i = 0, c = (u32)instancer.instances.size(); i < c; ++i) {
@@ -4758,6 +5341,61 @@ struct PipelineImpl final : Pipeline
 			}
 
 			PROFILE_BLOCK("fill instance data");
+			if (m_instance_gather_program) {
+				u32 instance_count = 0;
+				for (const AutoInstancer::Instances& instances : instancer.instances) {
+					if (instances.begin) instance_count += instances.end->offset + instances.end->count;
+				}
+				if (instance_count == 0) return;
+
+				const u32 output_size = instance_count * 2 * sizeof(Vec4);
+				const u32 output_offset = (u32)atomicAdd(&m_instance_gather_offset, output_size);
+				if (output_offset + output_size <= INSTANCE_GATHER_BUFFER_SIZE) {
+					InstanceGather& gather = instancer.gather;
+					gather.input = m_renderer.allocTransient(instance_count * 2 * sizeof(u32));
+					gather.count = instance_count;
+					u32* indices = (u32*)gather.input.ptr;
+					u32 offset = output_offset;
+					for (AutoInstancer::Instances& instances : instancer.instances) {
+						const AutoInstancer::Page::Group* group = instances.begin;
+						if (!group) continue;
+
+						const u32 count = instances.end->offset + instances.end->count;
+						instances.slice.buffer = m_instance_gather_buffer;
+						instances.slice.offset = offset;
+						instances.slice.size = count * 2 * sizeof(Vec4);
+						instances.slice.ptr = nullptr;
+						offset += instances.slice.size;
+
+						const u32 sort_key = u32(&instances - instancer.instances.begin());
+						const float mesh_lod = sort_key_to_mesh[sort_key]->lod;
+						while (group) {
+							for (u32 i = 0; i < group->count; ++i) {
+								const EntityRef e = { (i32)group->renderables[i] };
+								const float lod_d = model_instances[e.index].lod - mesh_lod;
+								indices[0] = e.index;
+								memcpy(&indices[1], &lod_d, sizeof(lod_d));
+								indices += 2;
+							}
+							group = group->next;
+						}
+					}
+
+					InstanceStoreUB ub;
+					const Vec3 camera_hi = Vec3(camera_pos);
+					ub.camera_hi = Vec4(camera_hi, 0);
+					ub.camera_lo = Vec4(Vec3(camera_pos - DVec3(camera_hi)), 0);
+					ub.input_offset = gather.input.offset / (2 * sizeof(u32));
+					ub.output_offset = output_offset / (2 * sizeof(Vec4));
+					ub.count = instance_count;
+					ub.padding = 0;
+					gather.ub = m_renderer.allocUniform(sizeof(ub));
+					memcpy(gather.ub.ptr, &ub, sizeof(ub));
+					return;
+				}
+			}
+
+			// fallback, gather buffer is full or the store is not available
 			for (AutoInstancer::Instances& instances : instancer.instances) {
 				const AutoInstancer::Page::Group* group = instances.begin;
 				if (!group) continue;
@@ -4792,115 +5430,6 @@ struct PipelineImpl final : Pipeline
 		view.sorter.pack();
 	}
 
-	struct Histogram {
-		static constexpr u32 BITS = 11;
-		static constexpr u32 SIZE = 1 << BITS;
-		static constexpr u32 BIT_MASK = SIZE - 1;
-		static constexpr i32 STEP = 4096;
-
-		u32 m_histogram[SIZE];
-		bool m_sorted;
-		jobs::Mutex m_cs;
-
-		void compute(const u64* keys, const u64* values, int size, u16 shift) {
-			memset(m_histogram, 0, sizeof(m_histogram));
-			m_sorted = true;
-
-			volatile i32 counter = 0;
-			auto work = [&](){
-				PROFILE_BLOCK("compute histogram");
-				u32 histogram[SIZE];
-				bool sorted = true;
-				memset(histogram, 0, sizeof(histogram));
-
-				i32 begin = atomicAdd(&counter, STEP);
-
-				while (begin < size) {
-					const i32 end = minimum(size, begin + STEP);
-
-					u64 key = begin > 0 ? keys[begin - 1] : keys[0];
-					u64 prev_key = key;
-					for (i32 i = begin; i < end; ++i) {
-						key = keys[i];
-						const u16 index = (key >> shift) & BIT_MASK;
-						++histogram[index];
-						sorted &= prev_key <= key;
-						prev_key = key;
-					}
-					begin = atomicAdd(&counter, STEP);
-				}
-
-				jobs::MutexGuard lock(m_cs);
-				m_sorted &= sorted;
-				for (u32 i = 0; i < lengthOf(m_histogram); ++i) {
-					m_histogram[i] += histogram[i]; 
-				}
-			};
-
-			if (size < STEP) {
-				work();
-			}
-			else {
-				jobs::runOnWorkers(work);
-			}
-		}
-	};
-
-
-	void radixSort(u64* _keys, u64* _values, int size) {
-		PROFILE_FUNCTION();
-		profiler::pushInt("count", size);
-		if (size == 0) return;
-
-		Array<u64> tmp_mem(m_allocator);
-
-		u64* keys = _keys;
-		u64* values = _values;
-		u64* tmp_keys = nullptr;
-		u64* tmp_values = nullptr;
-
-		Histogram histogram;
-		u16 shift = 0;
-
-		for (int pass = 0; pass < 6; ++pass) {
-			histogram.compute(keys, values, size, shift);
-
-			if (histogram.m_sorted) {
-				if (pass & 1) {
-					memcpy(_keys, tmp_mem.begin(), tmp_mem.byte_size() / 2);
-					memcpy(_values, &tmp_mem[size], tmp_mem.byte_size() / 2);
-				}
-				return;
-			}
-
-			if (!tmp_keys) {
-				tmp_mem.resize(size * 2);
-				tmp_keys = tmp_mem.begin();
-				tmp_values = &tmp_mem[size];
-			}
-
-			u32 offset = 0;
-			for (int i = 0; i < Histogram::SIZE; ++i) {
-				const u32 count = histogram.m_histogram[i];
-				histogram.m_histogram[i] = offset;
-				offset += count;
-			}
-
-			for (int i = 0; i < size; ++i) {
-				const u64 key = keys[i];
-				const u16 index = (key >> shift) & Histogram::BIT_MASK;
-				const u32 dest = histogram.m_histogram[index]++;
-				tmp_keys[dest] = key;
-				tmp_values[dest] = values[i];
-			}
-
-			swap(tmp_keys, keys);
-			swap(tmp_values, values);
-
-			shift += Histogram::BITS;
-		}
-	}
-
 	void clear(u32 flags, float r, float g, float b, float a, float depth) {
 		PROFILE_FUNCTION();
 		struct Cmd : Renderer::RenderJob {
@@ -5126,6 +5655,7 @@ struct PipelineImpl final : Pipeline
 		REGISTER_FUNCTION(renderTransparent);
 		REGISTER_FUNCTION(renderUI);
 		REGISTER_FUNCTION(saveRenderbuffer);
+		REGISTER_FUNCTION(setOcclusionCulling);
 		REGISTER_FUNCTION(setOutput);
 		REGISTER_FUNCTION(viewport);
 
@@ -5202,6 +5732,11 @@ struct PipelineImpl final : Pipeline
 	Draw2D m_draw2d;
 	Shader* m_draw2d_shader;
 	Array<UniquePtr<View>> m_views;
+	Array<UniquePtr<CullBatch>> m_cull_batches;
+	OcclusionBuffer m_occlusion_buffer;
+	LODCache m_lod_cache;
+	jobs::Mutex m_occlusion_mutex;
+	bool m_occlusion_culling = false;
 	jobs::Signal m_buckets_ready;
 	Viewport m_viewport;
 	Viewport m_prev_viewport;
@@ -5209,6 +5744,8 @@ struct PipelineImpl final : Pipeline
 	int m_output;
 	Shader* m_debug_shape_shader;
 	Shader* m_instancing_shader;
+	Shader* m_instance_store_shader;
+	gpu::ProgramHandle m_instance_gather_program = gpu::INVALID_PROGRAM;
 	Array<CustomCommandHandler> m_custom_commands_handlers;
 	Array<Renderbuffer> m_renderbuffers;
 	Array<ShaderRef> m_shaders;
@@ -5217,6 +5754,12 @@ struct PipelineImpl final : Pipeline
 	os::Timer m_timer;
 	volatile i32 m_indirect_buffer_offset;
 	gpu::BufferHandle m_instanced_meshes_buffer;
+	// render thread only
+	GPUBufferSizer m_instanced_meshes_sizer{INSTANCED_MESHES_BUFFER_INIT_SIZE};
+	// bytes the current frame's views can write to m_instanced_meshes_buffer, lives in StartPipelineJob
+	volatile i32* m_instanced_meshes_required = nullptr;
+	volatile i32 m_instance_gather_offset = 0;
+	gpu::BufferHandle m_instance_gather_buffer;
 	gpu::BufferHandle m_indirect_buffer;
 	gpu::VertexDecl m_base_vertex_decl;
 	gpu::VertexDecl m_2D_decl;
@@ -1,7 +1,7 @@
 #include "renderer/pose.h"
 #include "engine/math.h"
 #include "engine/profiler.h"
-#include "engine/math.h"
+#include "engine/simd.h"
 #include "renderer/model.h"
 
 
@@ -9,6 +9,94 @@ namespace Lumix
 {
 
 
+static u32 getPaddedCount(u32 count) {
+	return (count + 4) & ~3;
+}
+
+
+// negates t in lanes where the bit in mask is set
+static const struct NlerpSigns {
+	NlerpSigns() {
+		for (u32 mask = 0; mask < 16; ++mask) {
+			for (u32 lane = 0; lane < 4; ++lane) {
+				values[mask][lane] = mask & (1 << lane) ? -1.f : 1.f;
+			}
+		}
+	}
+	alignas(16) float values[16][4];
+} s_nlerp_signs;
+
+
+// 4 bones in SoA layout
+struct BonesSoA {
+	float4 px, py, pz;
+	float4 rx, ry, rz, rw;
+};
+
+
+static LUMIX_FORCE_INLINE BonesSoA load(const Vec3* positions, const Quat* rotations, const u8* indices) {
+	BonesSoA res;
+	res.rx = f4Load(&rotations[indices[0]]);
+	res.ry = f4Load(&rotations[indices[1]]);
+	res.rz = f4Load(&rotations[indices[2]]);
+	res.rw = f4Load(&rotations[indices[3]]);
+	f4Transpose(res.rx, res.ry, res.rz, res.rw);
+	// reads 4 bytes past the position, there's always a padding bone at the end
+	res.px = f4LoadUnaligned(&positions[indices[0]]);
+	res.py = f4LoadUnaligned(&positions[indices[1]]);
+	res.pz = f4LoadUnaligned(&positions[indices[2]]);
+	float4 tmp = f4LoadUnaligned(&positions[indices[3]]);
+	f4Transpose(res.px, res.py, res.pz, tmp);
+	return res;
+}
+
+
+static LUMIX_FORCE_INLINE void store(Vec3* positions, Quat* rotations, const u8* indices, BonesSoA& bones) {
+	f4Transpose(bones.rx, bones.ry, bones.rz, bones.rw);
+	f4Store(&rotations[indices[0]], bones.rx);
+	f4Store(&rotations[indices[1]], bones.ry);
+	f4Store(&rotations[indices[2]], bones.rz);
+	f4Store(&rotations[indices[3]], bones.rw);
+
+	// 16B stores would overwrite the next bone, which can be in a later batch
+	alignas(16) float tmp[3][4];
+	f4Store(tmp[0], bones.px);
+	f4Store(tmp[1], bones.py);
+	f4Store(tmp[2], bones.pz);
+	for (u32 i = 0; i < 4; ++i) {
+		positions[indices[i]] = Vec3(tmp[0][i], tmp[1][i], tmp[2][i]);
+	}
+}
+
+
+// same as Quat::rotate
+static LUMIX_FORCE_INLINE void rotate(const BonesSoA& q, float4& x, float4& y, float4& z) {
+	const float4 uv_x = f4Sub(f4Mul(q.ry, z), f4Mul(q.rz, y));
+	const float4 uv_y = f4Sub(f4Mul(q.rz, x), f4Mul(q.rx, z));
+	const float4 uv_z = f4Sub(f4Mul(q.rx, y), f4Mul(q.ry, x));
+	const float4 uuv_x = f4Sub(f4Mul(q.ry, uv_z), f4Mul(q.rz, uv_y));
+	const float4 uuv_y = f4Sub(f4Mul(q.rz, uv_x), f4Mul(q.rx, uv_z));
+	const float4 uuv_z = f4Sub(f4Mul(q.rx, uv_y), f4Mul(q.ry, uv_x));
+	const float4 w2 = f4Add(q.rw, q.rw);
+	const float4 two = f4Splat(2);
+	x = f4Add(x, f4Add(f4Mul(uv_x, w2), f4Mul(uuv_x, two)));
+	y = f4Add(y, f4Add(f4Mul(uv_y, w2), f4Mul(uuv_y, two)));
+	z = f4Add(z, f4Add(f4Mul(uv_z, w2), f4Mul(uuv_z, two)));
+}
+
+
+// bones.r = q * bones.r
+static LUMIX_FORCE_INLINE void multiply(const BonesSoA& q, BonesSoA& bones) {
+	const float4 x = f4Add(f4Add(f4Mul(q.rw, bones.rx), f4Mul(bones.rw, q.rx)), f4Sub(f4Mul(q.ry, bones.rz), f4Mul(bones.ry, q.rz)));
+	const float4 y = f4Add(f4Add(f4Mul(q.rw, bones.ry), f4Mul(bones.rw, q.ry)), f4Sub(f4Mul(q.rz, bones.rx), f4Mul(bones.rz, q.rx)));
+	const float4 z = f4Add(f4Add(f4Mul(q.rw, bones.rz), f4Mul(bones.rw, q.rz)), f4Sub(f4Mul(q.rx, bones.ry), f4Mul(bones.rx, q.ry)));
+	bones.rw = f4Sub(f4Sub(f4Mul(q.rw, bones.rw), f4Mul(q.rx, bones.rx)), f4Add(f4Mul(q.ry, bones.ry), f4Mul(q.rz, bones.rz)));
+	bones.rx = x;
+	bones.ry = y;
+	bones.rz = z;
+}
+
+
 Pose::Pose(IAllocator& allocator)
 	: allocator(allocator)
 {
@@ -21,8 +109,8 @@ Pose::Pose(IAllocator& allocator)
 
 Pose::~Pose()
 {
-	allocator.deallocate(positions);
-	allocator.deallocate(rotations);
+	if (positions) allocator.deallocate_aligned(positions);
+	if (rotations) allocator.deallocate_aligned(rotations);
 }
 
 
@@ -31,11 +119,50 @@ void Pose::blend(Pose& rhs, float weight)
 	ASSERT(count == rhs.count);
 	if (weight <= 0.001f) return;
 	weight = clamp(weight, 0.0f, 1.0f);
-	float inv = 1.0f - weight;
-	for (int i = 0, c = count; i < c; ++i)
-	{
-		positions[i] = positions[i] * inv + rhs.positions[i] * weight;
-		rotations[i] = nlerp(rotations[i], rhs.rotations[i], weight);
+	const float4 w = f4Splat(weight);
+	const float4 inv = f4Splat(1.0f - weight);
+	const u32 padded_count = getPaddedCount(count);
+
+	// 4 bones = 3 float4s
+	float* LUMIX_RESTRICT pos = &positions[0].x;
+	const float* LUMIX_RESTRICT rhs_pos = &rhs.positions[0].x;
+	for (u32 i = 0; i < padded_count * 3; i += 4) {
+		f4Store(pos + i, f4Add(f4Mul(f4Load(pos + i), inv), f4Mul(f4Load(rhs_pos + i), w)));
+	}
+
+	// nlerp
+	const float4 zero = f4Splat(0);
+	const float4 one = f4Splat(1);
+	for (u32 i = 0; i < padded_count; i += 4) {
+		float4 ax = f4Load(&rotations[i]);
+		float4 ay = f4Load(&rotations[i + 1]);
+		float4 az = f4Load(&rotations[i + 2]);
+		float4 aw = f4Load(&rotations[i + 3]);
+		f4Transpose(ax, ay, az, aw);
+		float4 bx = f4Load(&rhs.rotations[i]);
+		float4 by = f4Load(&rhs.rotations[i + 1]);
+		float4 bz = f4Load(&rhs.rotations[i + 2]);
+		float4 bw = f4Load(&rhs.rotations[i + 3]);
+		f4Transpose(bx, by, bz, bw);
+
+		const float4 dot = f4Add(f4Add(f4Mul(ax, bx), f4Mul(ay, by)), f4Add(f4Mul(az, bz), f4Mul(aw, bw)));
+		const float4 t = f4Mul(w, f4Load(s_nlerp_signs.values[f4MoveMask(f4CmpLT(dot, zero))]));
+		float4 x = f4Add(f4Mul(ax, inv), f4Mul(bx, t));
+		float4 y = f4Add(f4Mul(ay, inv), f4Mul(by, t));
+		float4 z = f4Add(f4Mul(az, inv), f4Mul(bz, t));
+		float4 qw = f4Add(f4Mul(aw, inv), f4Mul(bw, t));
+		const float4 len_sq = f4Add(f4Add(f4Mul(x, x), f4Mul(y, y)), f4Add(f4Mul(z, z), f4Mul(qw, qw)));
+		const float4 rcp_len = f4Div(one, f4Sqrt(len_sq));
+		x = f4Mul(x, rcp_len);
+		y = f4Mul(y, rcp_len);
+		z = f4Mul(z, rcp_len);
+		qw = f4Mul(qw, rcp_len);
+
+		f4Transpose(x, y, z, qw);
+		f4Store(&rotations[i], x);
+		f4Store(&rotations[i + 1], y);
+		f4Store(&rotations[i + 2], z);
+		f4Store(&rotations[i + 3], qw);
 	}
 }
 
@@ -43,13 +170,18 @@ void Pose::blend(Pose& rhs, float weight)
 void Pose::resize(int count)
 {
 	is_absolute = false;
-	allocator.deallocate(positions);
-	allocator.deallocate(rotations);
+	if (positions) allocator.deallocate_aligned(positions);
+	if (rotations) allocator.deallocate_aligned(rotations);
 	this->count = count;
 	if (count)
 	{
-		positions = static_cast<Vec3*>(allocator.allocate(sizeof(Vec3) * count));
-		rotations = static_cast<Quat*>(allocator.allocate(sizeof(Quat) * count));
+		const u32 padded_count = getPaddedCount(count);
+		positions = static_cast<Vec3*>(allocator.allocate_aligned(sizeof(Vec3) * padded_count, 16));
+		rotations = static_cast<Quat*>(allocator.allocate_aligned(sizeof(Quat) * padded_count, 16));
+		for (u32 i = count; i < padded_count; ++i) {
+			positions[i] = Vec3::ZERO;
+			rotations[i] = Quat::IDENTITY;
+		}
 	}
 	else
 	{
@@ -62,11 +194,16 @@ void Pose::resize(int count)
 void Pose::computeAbsolute(Model& model)
 {
 	if (is_absolute) return;
-	for (u32 i = model.getFirstNonrootBoneIndex(); i < count; ++i)
-	{
-		int parent = model.getBone(i).parent_idx;
-		positions[i] = rotations[parent].rotate(positions[i]) + positions[parent];
-		rotations[i] = rotations[parent] * rotations[i];
+	ASSERT(count == (u32)model.getBoneCount());
+	for (const Model::BoneBatch& batch : model.getBoneBatches()) {
+		const BonesSoA parents = load(positions, rotations, batch.parents);
+		BonesSoA bones = load(positions, rotations, batch.bones);
+		rotate(parents, bones.px, bones.py, bones.pz);
+		bones.px = f4Add(bones.px, parents.px);
+		bones.py = f4Add(bones.py, parents.py);
+		bones.pz = f4Add(bones.pz, parents.pz);
+		multiply(parents, bones);
+		store(positions, rotations, batch.bones, bones);
 	}
 	is_absolute = true;
 }
@@ -75,11 +212,23 @@ void Pose::computeAbsolute(Model& model)
 void Pose::computeRelative(Model& model)
 {
 	if (!is_absolute) return;
-	for (int i = count - 1; i >= model.getFirstNonrootBoneIndex(); --i)
-	{
-		int parent = model.getBone(i).parent_idx;
-		positions[i] = rotations[parent].conjugated().rotate(positions[i] - positions[parent]);
-		rotations[i] = rotations[parent].conjugated() * rotations[i];
+	ASSERT(count == (u32)model.getBoneCount());
+	const Span<const Model::BoneBatch> batches = model.getBoneBatches();
+	const float4 zero = f4Splat(0);
+	// children first, so their parents are still absolute
+	for (i32 i = batches.length() - 1; i >= 0; --i) {
+		const Model::BoneBatch& batch = batches[i];
+		BonesSoA parents = load(positions, rotations, batch.parents);
+		BonesSoA bones = load(positions, rotations, batch.bones);
+		// Quat::conjugated negates w, i.e. it's -conjugate, which is the same rotation;
+		// negating w rather than xyz keeps the results bit-identical to the scalar path
+		parents.rw = f4Sub(zero, parents.rw);
+		bones.px = f4Sub(bones.px, parents.px);
+		bones.py = f4Sub(bones.py, parents.py);
+		bones.pz = f4Sub(bones.pz, parents.pz);
+		rotate(parents, bones.px, bones.py, bones.pz);
+		multiply(parents, bones);
+		store(positions, rotations, batch.bones, bones);
 	}
 	is_absolute = false;
 }
@@ -28,6 +28,8 @@ struct LUMIX_RENDERER_API Pose
 	IAllocator& allocator;
 	bool is_absolute;
 	u32 count;
+	// 16B aligned and padded with identity bones to a multiple of 4 bones, with at least one padding bone,
+	// so SIMD code can always work on 4 bones at once
 	Vec3* positions;
 	Quat* rotations;
 	
@@ -99,7 +99,8 @@ struct RenderSceneImpl final : RenderScene {
 	~RenderSceneImpl()
 	{
 		m_renderer.destroy(m_reflection_probes_texture);
-		m_universe.entityTransformed().unbind<&RenderSceneImpl::onEntityMoved>(this);
+		if (m_model_instance_store.buffer) m_renderer.destroy(m_model_instance_store.buffer);
+		m_universe.entitiesTransformed().unbind<&RenderSceneImpl::onEntitiesMoved>(this);
 		m_universe.entityDestroyed().unbind<&RenderSceneImpl::onEntityDestroyed>(this);
 		m_culling_system.reset();
 	}
@@ -1001,6 +1002,7 @@ struct RenderSceneImpl final : RenderScene {
 					setModelInstanceMaterialOverride(e, Path(mat_path));
 				}
 
+				m_model_instance_store.markDirty(e);
 				m_universe.onComponentCreated(e, MODEL_INSTANCE_TYPE, this);
 			}
 		}
@@ -1047,6 +1049,7 @@ struct RenderSceneImpl final : RenderScene {
 					setModelInstanceMaterialOverride(e, Path(mat_path));
 				}
 
+				m_model_instance_store.markDirty(e);
 				m_universe.onComponentCreated(e, MODEL_INSTANCE_TYPE, this);
 			}
 		}
@@ -1462,6 +1465,9 @@ struct RenderSceneImpl final : RenderScene {
 		return m_model_instances;
 	}
 
+	ModelInstanceStore& getModelInstanceStore() override { return m_model_instance_store; }
+	SkinningPalettes& getSkinningPalettes() override { return m_skinning_palettes; }
+
 
 	ModelInstance* getModelInstance(EntityRef entity) override
 	{
@@ -1489,6 +1495,12 @@ struct RenderSceneImpl final : RenderScene {
 	}
 
 
+	void onEntitiesMoved(Span<const EntityRef> entities)
+	{
+		for (EntityRef e : entities) onEntityMoved(e);
+	}
+
+
 	void onEntityMoved(EntityRef entity)
 	{
 		const u64 cmp_mask = m_universe.getComponentsMask(entity);
@@ -1496,6 +1508,8 @@ struct RenderSceneImpl final : RenderScene {
 			return;
 		}
 
+		if (m_universe.hasComponent(entity, MODEL_INSTANCE_TYPE)) m_model_instance_store.markDirty(entity);
+
 		if (m_culling_system->isAdded(entity)) {
 			if (m_universe.hasComponent(entity, MODEL_INSTANCE_TYPE)) {
 				const Transform& tr = m_universe.getTransform(entity);
@@ -1967,6 +1981,18 @@ struct RenderSceneImpl final : RenderScene {
 	}
 
 
+	bool isModelInstanceOccluder(EntityRef entity) override
+	{
+		return m_model_instances[entity.index].flags.isSet(ModelInstance::OCCLUDER);
+	}
+
+
+	void setModelInstanceOccluder(EntityRef entity, bool is_occluder) override
+	{
+		m_model_instances[entity.index].flags.set(ModelInstance::OCCLUDER, is_occluder);
+	}
+
+
 	void enableModelInstance(EntityRef entity, bool enable) override
 	{
 		ModelInstance& model_instance = m_model_instances[entity.index];
@@ -2222,6 +2248,12 @@ struct RenderSceneImpl final : RenderScene {
 	}
 
 
+	void getRenderables(Span<const ShiftedFrustum> frusta, Span<CullResult*> results) const override
+	{
+		m_culling_system->cullMulti(frusta, results);
+	}
+
+
 	float getCameraScreenWidth(EntityRef camera) override { return m_cameras[camera].screen_width; }
 	float getCameraScreenHeight(EntityRef camera) override { return m_cameras[camera].screen_height; }
 
@@ -2897,6 +2929,7 @@ struct RenderSceneImpl final : RenderScene {
 		}
 		r.meshes = &r.model->getMesh(0);
 		r.mesh_count = r.model->getMeshCount();
+		m_model_instance_store.markDirty(entity);
 
 		if (r.flags.isSet(ModelInstance::IS_BONE_ATTACHMENT_PARENT)) {
 			for (auto& attachment : m_bone_attachments) {
@@ -3250,6 +3283,7 @@ struct RenderSceneImpl final : RenderScene {
 		r.flags.set(ModelInstance::VALID);
 		r.flags.set(ModelInstance::ENABLED);
 		r.mesh_count = 0;
+		m_model_instance_store.markDirty(entity);
 		m_universe.onComponentCreated(entity, MODEL_INSTANCE_TYPE, this);
 	}
 
@@ -3287,6 +3321,8 @@ struct RenderSceneImpl final : RenderScene {
 	HashMap<EntityRef, Decal> m_decals;
 	HashMap<EntityRef, CurveDecal> m_curve_decals;
 	Array<ModelInstance> m_model_instances;
+	ModelInstanceStore m_model_instance_store;
+	SkinningPalettes m_skinning_palettes;
 	HashMap<EntityRef, InstancedModel> m_instanced_models;
 	HashMap<EntityRef, Environment> m_environments;
 	HashMap<EntityRef, Camera> m_cameras;
@@ -3461,6 +3497,7 @@ void RenderScene::reflect() {
 		.LUMIX_CMP(ModelInstance, "model_instance", "Render / Mesh")
 			.LUMIX_FUNC_EX(RenderScene::getModelInstanceModel, "getModel")
 			.prop<&RenderScene::isModelInstanceEnabled, &RenderScene::enableModelInstance>("Enabled")
+			.prop<&RenderScene::isModelInstanceOccluder, &RenderScene::setModelInstanceOccluder>("Occluder")
 			.prop<&RenderScene::getModelInstanceMaterialOverride,&RenderScene::setModelInstanceMaterialOverride>("Material").noUIAttribute()
 			.LUMIX_PROP(ModelInstancePath, "Source").resourceAttribute(Model::TYPE)
 		.LUMIX_CMP(Environment, "environment", "Render / Environment")
@@ -3516,6 +3553,8 @@ RenderSceneImpl::RenderSceneImpl(Renderer& renderer,
 	, m_allocator(allocator)
 	, m_model_entity_map(m_allocator)
 	, m_model_instances(m_allocator)
+	, m_model_instance_store(m_allocator)
+	, m_skinning_palettes(m_allocator)
 	, m_instanced_models(m_allocator)
 	, m_cameras(m_allocator)
 	, m_terrains(m_allocator)
@@ -3540,7 +3579,7 @@ RenderSceneImpl::RenderSceneImpl(Renderer& renderer,
 	, m_furs(m_allocator)
 {
 
-	m_universe.entityTransformed().bind<&RenderSceneImpl::onEntityMoved>(this);
+	m_universe.entitiesTransformed().bind<&RenderSceneImpl::onEntitiesMoved>(this);
 	m_universe.entityDestroyed().bind<&RenderSceneImpl::onEntityDestroyed>(this);
 	m_culling_system = CullingSystem::create(m_allocator, engine.getPageAllocator());
 	m_model_instances.reserve(5000);
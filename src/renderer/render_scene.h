@@ -177,6 +177,8 @@ struct ModelInstance
 		IS_BONE_ATTACHMENT_PARENT = 1 << 0,
 		ENABLED = 1 << 1,
 		VALID = 1 << 2,
+		// rasterized into occlusion buffer using its lowest LOD
+		OCCLUDER = 1 << 3,
 	};
 
 	Model* model;
@@ -190,6 +192,53 @@ struct ModelInstance
 	u16 mesh_count;
 };
 
+// transforms of model instances kept on GPU between frames, slot = entity index
+// only instances created or moved since the last flush are uploaded, see Pipeline
+struct ModelInstanceStore {
+	// vec4(rotation.xyz, scale), vec4(position hi), vec4(position lo)
+	static constexpr u32 STRIDE = 3 * sizeof(Vec4);
+
+	ModelInstanceStore(IAllocator& allocator)
+		: dirty(allocator)
+		, dirty_mask(allocator)
+		, versions(allocator)
+	{}
+
+	void markDirty(EntityRef e) {
+		while (e.index >= dirty_mask.size()) {
+			dirty_mask.push(0);
+			versions.push(0);
+		}
+		++versions[e.index];
+		if (dirty_mask[e.index]) return;
+		dirty_mask[e.index] = 1;
+		dirty.push(e);
+	}
+
+	gpu::BufferHandle buffer = gpu::INVALID_BUFFER;
+	u32 capacity = 0;
+	Array<EntityRef> dirty;
+	Array<u8> dirty_mask;
+	// bumped whenever transform or model of an instance changes, used to validate per-instance caches
+	Array<u32> versions;
+};
+
+// dual quaternion bone palettes of skinned model instances, computed once per frame and shared by all views
+// the first pipeline to render in a frame fills them, see Pipeline
+struct SkinningPalettes {
+	static constexpr u32 INVALID_OFFSET = 0xffFFffFF;
+
+	SkinningPalettes(IAllocator& allocator)
+		: offsets(allocator)
+	{}
+
+	// renderer's frame number the palettes were computed in
+	u32 frame = 0xffFFffFF;
+	gpu::BufferHandle buffer = gpu::INVALID_BUFFER;
+	// offset of entity's palette in `buffer` in vec4s, indexed by entity
+	Array<u32> offsets;
+};
+
 struct InstancedModel {
 	InstancedModel(IAllocator& allocator) 
 		: instances(allocator)
@@ -375,9 +424,13 @@ struct LUMIX_RENDERER_API RenderScene : IScene
 
 	virtual void enableModelInstance(EntityRef entity, bool enable) = 0;
 	virtual bool isModelInstanceEnabled(EntityRef entity) = 0;
+	virtual void setModelInstanceOccluder(EntityRef entity, bool is_occluder) = 0;
+	virtual bool isModelInstanceOccluder(EntityRef entity) = 0;
 	virtual ModelInstance* getModelInstance(EntityRef entity) = 0;
 	virtual Span<const ModelInstance> getModelInstances() const = 0;
 	virtual Span<ModelInstance> getModelInstances() = 0;
+	virtual ModelInstanceStore& getModelInstanceStore() = 0;
+	virtual SkinningPalettes& getSkinningPalettes() = 0;
 	virtual Path getModelInstancePath(EntityRef entity) = 0;
 	virtual void setModelInstanceLOD(EntityRef entity, u32 lod) = 0;
 	virtual void setModelInstancePath(EntityRef entity, const Path& path) = 0;
@@ -385,6 +438,7 @@ struct LUMIX_RENDERER_API RenderScene : IScene
 	virtual Path getModelInstanceMaterialOverride(EntityRef entity) = 0;
 	virtual CullResult* getRenderables(const ShiftedFrustum& frustum, RenderableTypes type) const = 0;
 	virtual CullResult* getRenderables(const ShiftedFrustum& frustum) const = 0;
+	virtual void getRenderables(Span<const ShiftedFrustum> frusta, Span<CullResult*> results) const = 0;
 	virtual EntityPtr getFirstModelInstance() = 0;
 	virtual EntityPtr getNextModelInstance(EntityPtr entity) = 0;
 	virtual Model* getModelInstanceModel(EntityRef entity) = 0;
@@ -54,6 +54,32 @@ static const char* downscale_src = R"#(
 )#";
 
 
+bool GPUBufferSizer::update(u32 used_bytes) {
+	used = used_bytes;
+	if (used > size) {
+		size = nextPow2(used);
+		high_water = 0;
+		low_frames = 0;
+		return true;
+	}
+
+	if (size <= min_size || used > size / 4) {
+		high_water = 0;
+		low_frames = 0;
+		return false;
+	}
+
+	high_water = maximum(high_water, used);
+	++low_frames;
+	if (low_frames < SHRINK_FRAMES) return false;
+
+	size = maximum(min_size, nextPow2(high_water) * 2);
+	high_water = 0;
+	low_frames = 0;
+	return true;
+}
+
+
 template <u32 ALIGN>
 struct TransientBuffer {
 	static constexpr u32 INIT_SIZE = 1024 * 1024;
@@ -122,6 +148,14 @@ struct TransientBuffer {
 			m_buffer = m_overflow.buffer;
 			m_overflow.buffer = gpu::INVALID_BUFFER;
 			m_overflow.size = 0;
+			m_sizer.update(m_size);
+		}
+		else if (m_sizer.update(m_offset)) {
+			// gpu is done with this frame, so the buffer can be replaced
+			gpu::destroy(m_buffer);
+			m_buffer = gpu::allocBufferHandle();
+			m_size = m_sizer.size;
+			gpu::createBuffer(m_buffer, gpu::BufferFlags::MAPPABLE | m_flags, m_size, nullptr);
 		}
 
 		ASSERT(!m_ptr);
@@ -135,6 +169,7 @@ struct TransientBuffer {
 	u8* m_ptr = nullptr;
 	jobs::Mutex m_mutex;
 	gpu::BufferFlags m_flags = gpu::BufferFlags::NONE;
+	GPUBufferSizer m_sizer{INIT_SIZE};
 
 	struct {
 		gpu::BufferHandle buffer = gpu::INVALID_BUFFER;
@@ -1237,6 +1272,17 @@ struct RendererImpl final : Renderer
 			profiler::pushCounter(texture_counter, to_MB(mem_stats.texture_mem));
 		}
 
+		{
+			static u32 transient_used_counter = profiler::createCounter("Transient buffer used (kB)", 0);
+			static u32 transient_size_counter = profiler::createCounter("Transient buffer size (kB)", 0);
+			static u32 uniform_used_counter = profiler::createCounter("Uniform buffer used (kB)", 0);
+			static u32 uniform_size_counter = profiler::createCounter("Uniform buffer size (kB)", 0);
+			profiler::pushCounter(transient_used_counter, frame.transient_buffer.m_offset / 1024.f);
+			profiler::pushCounter(transient_size_counter, frame.transient_buffer.m_size / 1024.f);
+			profiler::pushCounter(uniform_used_counter, frame.uniform_buffer.m_offset / 1024.f);
+			profiler::pushCounter(uniform_size_counter, frame.uniform_buffer.m_size / 1024.f);
+		}
+
 		for (const auto& i : frame.to_compile_shaders) {
 			Shader::compile(i.program, i.decl, i.defines, i.sources, *this);
 		}
@@ -13,6 +13,22 @@ struct RenderPlugin {
 	virtual void renderTransparent(Pipeline& pipeline) {}
 };
 
+// size policy for gpu buffers reused every frame
+// grows as soon as a frame needs more, shrinks once the buffer has been mostly unused for SHRINK_FRAMES frames
+struct LUMIX_RENDERER_API GPUBufferSizer {
+	static constexpr u32 SHRINK_FRAMES = 300;
+
+	GPUBufferSizer(u32 min_size) : min_size(min_size), size(min_size) {}
+	// returns true if the buffer must be recreated with new `size`
+	bool update(u32 used_bytes);
+
+	u32 min_size;
+	u32 size;
+	u32 used = 0;
+	u32 high_water = 0;
+	u32 low_frames = 0;
+};
+
 struct LUMIX_RENDERER_API Renderer : IPlugin {
 	struct MemRef {
 		u32 size = 0;